@@ -0,0 +1,166 @@
+#include "Benchmark.h"
+#include "Ensemble.h"
+#include "Fauna.h"
+#include "FlowField.h"
+#include "Simulation.h"
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <cstdio>
+
+// Powers of two up to the number of cores, and the number of cores itself
+static std::vector<int> GetBenchmarkThreadCounts()
+{
+    std::vector<int> threadCounts;
+    int maxThreads = JobSystem::GetDefaultWorkerCount() + 1;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+    return threadCounts;
+}
+
+void RunMoleculeBenchmark()
+{
+    const int moleculeCounts[] = { 10000, 100000, 1000000 };
+    const int steps = 20;
+
+    std::vector<int> threadCounts = GetBenchmarkThreadCounts();
+
+    std::printf("%12s %8s %12s %10s\n", "molecules", "threads", "ms/step", "speedup");
+    for (int moleculeCount : moleculeCounts)
+    {
+        VariableData data;
+        data.Initialize("Benchmark", 0, (float)moleculeCount, sf::Color::Red, 5, 3, moleculeCount);
+        data.Level = (float)moleculeCount;
+        std::vector<VariableData*> species = { &data };
+
+        float singleThreadTime = 0;
+        for (int threads : threadCounts)
+        {
+            JobSystem jobs(threads - 1);
+
+            // Warm up the caches and the workers before timing
+            for (int step = 0; step < 3; step++)
+            {
+                jobs.Wait(DispatchMoleculeUpdate(jobs, species, 1, step));
+                SwapMoleculeBuffers(species);
+            }
+
+            sf::Clock clock;
+            for (int step = 0; step < steps; step++)
+            {
+                jobs.Wait(DispatchMoleculeUpdate(jobs, species, 1, step));
+                SwapMoleculeBuffers(species);
+            }
+            float time = clock.getElapsedTime().asSeconds() * 1000 / steps;
+
+            if (threads == 1)
+                singleThreadTime = time;
+            std::printf("%12d %8d %12.3f %9.2fx\n", moleculeCount, threads, time, singleThreadTime / time);
+        }
+    }
+}
+
+void RunFaunaBenchmark()
+{
+    const int animalCounts[] = { 1000, 10000, 100000 };
+    const int steps = 20;
+
+    std::vector<int> threadCounts = GetBenchmarkThreadCounts();
+
+    // Fish are the expensive kind, one in five is a fish as in the shipped capacities
+    FlowField flow;
+    flow.Initialize(1);
+    std::printf("%12s %8s %12s %14s\n", "animals", "threads", "ms/step", "animals/ms");
+    for (int animalCount : animalCounts)
+    {
+        for (int threads : threadCounts)
+        {
+            Fauna fauna;
+            fauna.Capacity[FaunaFish] = animalCount / 5;
+            fauna.Capacity[FaunaPlankton] = animalCount - animalCount / 5;
+            fauna.Initialize(1);
+            JobSystem jobs(threads - 1);
+
+            // Let the schools form before timing
+            for (int step = 0; step < 30; step++)
+            {
+                jobs.Wait(fauna.Dispatch(jobs, 1, step, 0, flow));
+                fauna.Finish(1, step, 0);
+            }
+
+            sf::Clock clock;
+            for (int step = 0; step < steps; step++)
+            {
+                jobs.Wait(fauna.Dispatch(jobs, 1, step, 0, flow));
+                fauna.Finish(1, step, 0);
+            }
+            float time = clock.getElapsedTime().asSeconds() * 1000 / steps;
+            std::printf("%12d %8d %12.3f %14.0f\n", fauna.GetCount(), threads, time, fauna.GetCount() / time);
+        }
+    }
+}
+
+void RunEnsembleBenchmark()
+{
+    const int memberCounts[] = { 1000, 10000, 100000 };
+    const int steps = 50;
+
+    std::vector<int> threadCounts = GetBenchmarkThreadCounts();
+
+    // Halfway up the carbon dioxide range, so the members are on their way somewhere
+    InitializeSimulation(1);
+    const VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    std::printf("%12s %8s %12s %18s\n", "members", "threads", "ms/step", "member steps/s");
+    for (int memberCount : memberCounts)
+    {
+        for (int threads : threadCounts)
+        {
+            SetCarbonDioxide(control.Min);
+            ChemistryEnsemble ensemble;
+            ensemble.Initialize(memberCount, 1);
+            SetCarbonDioxide(control.Min + control.GetRange() / 2);
+            JobSystem jobs(threads - 1);
+
+            sf::Clock clock;
+            for (int step = 0; step < steps; step++)
+            {
+                jobs.Wait(ensemble.Dispatch(jobs));
+                ensemble.Finish();
+            }
+            float time = clock.getElapsedTime().asSeconds() * 1000 / steps;
+            std::printf("%12d %8d %12.3f %18.0f\n", memberCount, threads, time, memberCount * 1000.0 / time);
+        }
+    }
+}
+
+void FrameTimeRecorder::Start(float seconds)
+{
+    frameTimes.clear();
+    remainingTime = seconds;
+    std::printf("Recording frame times for %.1f s\n", seconds);
+}
+
+bool FrameTimeRecorder::IsRecording() const
+{
+    return remainingTime > 0;
+}
+
+void FrameTimeRecorder::Add(float frameTime)
+{
+    if (!IsRecording())
+        return;
+
+    frameTimes.push_back(frameTime);
+    remainingTime -= frameTime;
+    if (IsRecording() || frameTimes.empty())
+        return;
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    float total = 0;
+    for (float time : frameTimes)
+        total += time;
+    auto percentile = [this](float p) { return frameTimes[std::min((size_t)(p * frameTimes.size()), frameTimes.size() - 1)] * 1000; };
+
+    std::printf("%zu frames: average %.2f ms, median %.2f ms, 95%% %.2f ms, 99%% %.2f ms, worst %.2f ms\n",
+        frameTimes.size(), total * 1000 / frameTimes.size(), percentile(0.5f), percentile(0.95f), percentile(0.99f), frameTimes.back() * 1000);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+
+// Time the parallel molecule update at 10k, 100k and 1M molecules on 1 up to all cores and print the results
+void RunMoleculeBenchmark();
+
+// Time the animals at 1k, 10k and 100k on 1 up to all cores and print how many are moved per millisecond
+void RunFaunaBenchmark();
+
+// Time the chemistry ensemble at 1k, 10k and 100k members on 1 up to all cores and print how many member steps
+// are done per second; needs the species configuration
+void RunEnsembleBenchmark();
+
+// Records the frame times of a running instance for a while, then prints their distribution
+struct FrameTimeRecorder
+{
+    void Start(float seconds);
+
+    // Call once per frame; prints the summary when the recording time is up
+    void Add(float frameTime);
+
+    bool IsRecording() const;
+
+private:
+    std::vector<float> frameTimes;
+    float remainingTime = 0;
+};
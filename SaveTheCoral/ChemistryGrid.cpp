@@ -0,0 +1,229 @@
+#include "ChemistryGrid.h"
+#include "CoralGrowth.h"
+#include "FlowField.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+ChemistryGrid chemistryGrid;
+
+// Spread per step, in cells squared; explicit diffusion is stable up to 0.25
+const float diffusionRate = 0.15f;
+
+// Fraction of the way to the surface level the top row moves per step
+const float surfaceExchangeRate = 0.1f;
+
+// Fraction of the carbon dioxide above its minimum that coral fully covering a cell takes up per step
+const float coralUptakeRate = 0.001f;
+
+// Fraction of the way to its chemical balance with the local carbon dioxide a species moves per step
+const float reactionRate = 0.02f;
+
+void ChemistryGrid::Initialize(const std::vector<VariableData*>& species)
+{
+    Width = std::max((int)std::lround(reefRect.width / chemistryCellSize), 3);
+    Height = std::max((int)std::lround(reefRect.height / chemistryCellSize), 3);
+    Current = 0;
+    flowU.assign((size_t)Width * Height, 0.0f);
+    flowV.assign((size_t)Width * Height, 0.0f);
+    coralCover.assign((size_t)Width * Height, 0.0f);
+    coralCoverGeneration = 0;
+
+    for (VariableData* data : species)
+        Fill(*data, data->Level);
+}
+
+void ChemistryGrid::Fill(VariableData& data, float level) const
+{
+    for (int buffer = 0; buffer < 2; buffer++)
+        data.Concentration[buffer].assign((size_t)Width * Height, level);
+    data.CumulativeConcentration.resize((size_t)Width * Height);
+    for (int i = 0; i < Width * Height; i++)
+        data.CumulativeConcentration[i] = (i + 1) * std::max(level, 0.0f);
+    data.Level = level;
+}
+
+JobSystem::Handle ChemistryGrid::Dispatch(JobSystem& jobs, const std::vector<VariableData*>& species, const FlowField& flow, const CoralReef& coral)
+{
+    // Capture how every species reacts as it is now
+    auto stepSpecies = std::make_shared<std::vector<StepSpecies>>();
+    for (size_t s = 0; s < species.size(); s++)
+        stepSpecies->push_back({ species[s], (int)s == speciesConfig.ControlSpecies ? Control : Inert });
+    for (const SpeciesConfig::Reaction& reaction : speciesConfig.Reactions)
+        (*stepSpecies)[reaction.Species].Role = reaction.Rises ? Rises : Falls;
+    if (waterTemperatureSpecies >= 0 && waterTemperatureSpecies != speciesConfig.ControlSpecies)
+        (*stepSpecies)[waterTemperatureSpecies].Role = Heat;
+
+    // The coral only changes every few steps, the cover is only worked out again then
+    bool updateCover = coral.Generation != coralCoverGeneration;
+    coralCoverGeneration = coral.Generation;
+
+    int bands = (Height + chemistryBandRows - 1) / chemistryBandRows;
+    return jobs.Dispatch(bands, 1, [this, stepSpecies, &flow, &coral, updateCover](int begin, int end)
+    {
+        for (int band = begin; band < end; band++)
+        {
+            int rowBegin = band * chemistryBandRows;
+            StepBand(rowBegin, std::min(rowBegin + chemistryBandRows, Height), *stepSpecies, flow, coral, updateCover);
+        }
+    });
+}
+
+void ChemistryGrid::StepBand(int begin, int end, const std::vector<StepSpecies>& species, const FlowField& flow, const CoralReef& coral, bool updateCover)
+{
+    float cellWidth = reefRect.width / Width;
+    float cellHeight = reefRect.height / Height;
+
+    for (int y = begin; y < end; y++)
+    {
+        for (int x = 0; x < Width; x++)
+        {
+            float u, v;
+            flow.Sample(reefRect.left + (x + 0.5f) * cellWidth, reefRect.top + (y + 0.5f) * cellHeight, u, v);
+            flowU[y * Width + x] = u / cellWidth;
+            flowV[y * Width + x] = v / cellHeight;
+        }
+    }
+
+    if (updateCover && coral.Width > 0)
+    {
+        const uint8_t* cells = coral.GetCells();
+        for (int y = begin; y < end; y++)
+        {
+            int coralTop = y * coral.Height / Height;
+            int coralBottom = std::max((y + 1) * coral.Height / Height, coralTop + 1);
+            for (int x = 0; x < Width; x++)
+            {
+                int coralLeft = x * coral.Width / Width;
+                int coralRight = std::max((x + 1) * coral.Width / Width, coralLeft + 1);
+                int sum = 0;
+                for (int coralY = coralTop; coralY < coralBottom; coralY++)
+                {
+                    for (int coralX = coralLeft; coralX < coralRight; coralX++)
+                        sum += cells[coralY * coral.Width + coralX];
+                }
+                coralCover[y * Width + x] = sum / (255.0f * (coralBottom - coralTop) * (coralRight - coralLeft));
+            }
+        }
+    }
+
+    const VariableData* control = nullptr;
+    for (const StepSpecies& stepSpecies : species)
+    {
+        if (stepSpecies.Role == Control)
+            control = stepSpecies.Data;
+    }
+
+    for (const StepSpecies& stepSpecies : species)
+    {
+        VariableData& data = *stepSpecies.Data;
+        const float* current = data.Concentration[Current].data();
+        float* next = data.Concentration[1 - Current].data();
+        const float* carbonDioxide = control->Concentration[Current].data();
+        float controlMin = control->Min;
+        float controlScale = 1.0f / control->GetRange();
+        float rising = stepSpecies.Role == Rises ? 1.0f : 0.0f;
+
+        if (stepSpecies.Role == Heat)
+        {
+            std::copy(current + begin * Width, current + end * Width, next + begin * Width);
+            continue;
+        }
+
+        for (int y = begin; y < end; y++)
+        {
+            // Beyond the surface and the seabed the concentration is mirrored, left and right wrap around
+            const float* above = current + std::max(y - 1, 0) * Width;
+            const float* here = current + y * Width;
+            const float* below = current + std::min(y + 1, Height - 1) * Width;
+            const float* rowU = flowU.data() + y * Width;
+            const float* rowV = flowV.data() + y * Width;
+            float* out = next + y * Width;
+
+            // Spread out and drift downstream, upwind so the drift never overshoots; the columns in between vectorize
+            auto transport = [&](int x, int left, int right)
+            {
+                float value = here[x];
+                float spread = here[left] + here[right] + above[x] + below[x] - 4 * value;
+                float drift = std::max(rowU[x], 0.0f) * (value - here[left]) + std::min(rowU[x], 0.0f) * (here[right] - value) +
+                              std::max(rowV[x], 0.0f) * (value - above[x]) + std::min(rowV[x], 0.0f) * (below[x] - value);
+                out[x] = value + diffusionRate * spread - drift;
+            };
+            transport(0, Width - 1, 1);
+            for (int x = 1; x < Width - 1; x++)
+                transport(x, x - 1, x + 1);
+            transport(Width - 1, Width - 2, 0);
+
+            // React where the species is
+            const float* rowCarbonDioxide = carbonDioxide + y * Width;
+            if (stepSpecies.Role == Control)
+            {
+                const float* rowCover = coralCover.data() + y * Width;
+                for (int x = 0; x < Width; x++)
+                    out[x] -= std::max(here[x] - controlMin, 0.0f) * coralUptakeRate * rowCover[x];
+                if (y == 0)
+                {
+                    for (int x = 0; x < Width; x++)
+                        out[x] += (SurfaceLevel - here[x]) * surfaceExchangeRate;
+                }
+            }
+            else if (stepSpecies.Role != Inert)
+            {
+                // Each species has a balance for the carbon dioxide level, as set out in the configuration
+                float base = rising * data.Min + (1 - rising) * data.Max;
+                float slope = (2 * rising - 1) * data.GetRange();
+                for (int x = 0; x < Width; x++)
+                {
+                    float pollution = std::min(std::max((rowCarbonDioxide[x] - controlMin) * controlScale, 0.0f), 1.0f);
+                    out[x] += (base + slope * pollution - here[x]) * reactionRate;
+                }
+            }
+        }
+    }
+}
+
+void ChemistryGrid::Swap(JobSystem& jobs, const std::vector<VariableData*>& species)
+{
+    Current = 1 - Current;
+
+    // Levels and the running sums for placing molecules, one species per job
+    int cells = Width * Height;
+    jobs.ParallelFor((int)species.size(), 1, [this, &species, cells](int begin, int end)
+    {
+        for (int s = begin; s < end; s++)
+        {
+            VariableData& data = *species[s];
+            const float* concentration = data.Concentration[Current].data();
+            float* cumulative = data.CumulativeConcentration.data();
+            double sum = 0;
+            for (int i = 0; i < cells; i++)
+            {
+                sum += std::max(concentration[i], 0.0f);
+                cumulative[i] = (float)sum;
+            }
+            data.Level = (float)(sum / cells);
+        }
+    });
+}
+
+void ChemistryGrid::SamplePosition(const VariableData& data, Random& random, float& x, float& y) const
+{
+    const std::vector<float>& cumulative = data.CumulativeConcentration;
+    int cell = 0;
+    if (!cumulative.empty() && cumulative.back() > 0)
+    {
+        float target = (random.Next() >> 8) * (1.0f / (1 << 24)) * cumulative.back();
+        cell = (int)(std::upper_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin());
+        cell = std::min(cell, (int)cumulative.size() - 1);
+    }
+    else
+    {
+        cell = random.NextInt(Width * Height);
+    }
+
+    float cellWidth = reefRect.width / Width;
+    float cellHeight = reefRect.height / Height;
+    x = reefRect.left + (cell % Width + (random.Next() >> 8) * (1.0f / (1 << 24))) * cellWidth;
+    y = reefRect.top + (cell / Width + (random.Next() >> 8) * (1.0f / (1 << 24))) * cellHeight;
+}
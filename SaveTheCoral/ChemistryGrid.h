@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+struct CoralReef;
+struct FlowField;
+struct Random;
+struct VariableData;
+
+// Size of a chemistry cell in layout units
+const float chemistryCellSize = 20;
+
+// Every molecule is placed again by the concentration about once in this many steps
+const uint32_t moleculeResampleInterval = 128;
+
+// Rows of cells per job. A job steps every species over its rows, so the cells of all species at one place are in
+// cache together when they react.
+const int chemistryBandRows = 8;
+
+// The chemistry happens on a grid over reefRect: every species has a concentration per cell (stored with the species,
+// see VariableData::Concentration), and its Level is the mean over the grid. Each step the concentrations spread
+// out, drift with the current and react with the carbon dioxide where they are. Carbon dioxide dissolves into the
+// water at the surface towards the level the user sets, and the coral takes it up. The water temperature is the
+// exception: it comes from the temperature field (see TemperatureField), and is only carried over here.
+struct ChemistryGrid
+{
+    int Width = 0;
+    int Height = 0;
+
+    // Which of the species' concentration buffers is current
+    int Current = 0;
+
+    // Level of the control species at the surface, as set by the user
+    float SurfaceLevel = 0;
+
+    // Size the grid to the reef, and fill every species' grid evenly with its Level
+    void Initialize(const std::vector<VariableData*>& species);
+
+    // Fill one species' grid evenly, for a species that was just added
+    void Fill(VariableData& data, float level) const;
+
+    // Queue one step of every species on the job system, one job per band of rows. Until the handle is waited on
+    // only the current concentrations may be read, and the flow and coral must not change; afterwards call Swap.
+    JobSystem::Handle Dispatch(JobSystem& jobs, const std::vector<VariableData*>& species, const FlowField& flow, const CoralReef& coral);
+
+    // Make the new concentrations current and update the species' Levels and molecule placement from them
+    void Swap(JobSystem& jobs, const std::vector<VariableData*>& species);
+
+    // A random position on the reef, more likely where the species' concentration is higher
+    void SamplePosition(const VariableData& data, Random& random, float& x, float& y) const;
+
+private:
+    enum SpeciesRole
+    {
+        Inert,
+        Control,
+        Rises,
+        Falls,
+
+        // Set by the temperature field, the chemistry only carries it over
+        Heat
+    };
+
+    struct StepSpecies
+    {
+        VariableData* Data;
+        SpeciesRole Role;
+    };
+
+    void StepBand(int begin, int end, const std::vector<StepSpecies>& species, const FlowField& flow, const CoralReef& coral, bool updateCover);
+
+    // Current in cells per step and the share of each cell covered by coral, at the cell centers
+    std::vector<float> flowU;
+    std::vector<float> flowV;
+    std::vector<float> coralCover;
+    uint64_t coralCoverGeneration = 0;
+};
+
+extern ChemistryGrid chemistryGrid;
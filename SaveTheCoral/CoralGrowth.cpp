@@ -0,0 +1,162 @@
+#include "CoralGrowth.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+CoralReef coralReef;
+
+// Coral only settles in the lower part of the reef, and grows faster the deeper it is there
+const float coralSubstrateTop = 0.6f;
+
+// Chances per growth step out of 65536
+const int maxSpreadChance = 2400;
+const int maxSettleChance = 2;
+const int maxDecayChance = 900;
+
+// Density of new coral, and how much a cell gains or loses per growth step
+const int newCoralDensity = 24;
+const int maxThickening = 12;
+const int decayAmount = 40;
+
+void CoralReef::Initialize(uint32_t seed)
+{
+    Width = (int)reefRect.width / coralCellSize;
+    Height = (int)reefRect.height / coralCellSize;
+    TilesX = (Width + coralTileSize - 1) / coralTileSize;
+    TilesY = (Height + coralTileSize - 1) / coralTileSize;
+    for (int buffer = 0; buffer < 2; buffer++)
+        Cells[buffer].assign(Width * Height, 0);
+    Current = 0;
+
+    Random random(seed ^ 0xc07a1u);
+    int substrateTop = (int)(Height * coralSubstrateTop);
+    for (int colony = 0; colony < 40; colony++)
+    {
+        int x = random.NextInt(Width);
+        int y = substrateTop + random.NextInt(Height - substrateTop);
+        Cells[0][y * Width + x] = 128;
+    }
+
+    Generation++;
+    TileVersions.assign(TilesX * TilesY, Generation);
+}
+
+JobSystem::Handle CoralReef::Dispatch(JobSystem& jobs, uint32_t seed, uint64_t step, float growth, float acidity, float heat)
+{
+    Generation++;
+    uint64_t generation = Generation;
+    int spreadChance = (int)(maxSpreadChance * growth);
+    int settleChance = (int)std::ceil(maxSettleChance * growth);
+    int thickening = (int)(maxThickening * growth);
+    int decayChance = (int)(maxDecayChance * (acidity + heat) / 2);
+    uint32_t stepSeed = Random::Hash(seed ^ 0xc07a1u ^ Random::Hash((uint32_t)step) ^ Random::Hash((uint32_t)(step >> 32) + 7));
+
+    return jobs.Dispatch(TilesY, 1, [this, generation, spreadChance, settleChance, thickening, decayChance, stepSeed](int begin, int end)
+    {
+        const uint8_t* current = Cells[Current].data();
+        uint8_t* next = Cells[1 - Current].data();
+        int substrateTop = (int)(Height * coralSubstrateTop);
+
+        for (int tileY = begin; tileY < end; tileY++)
+        {
+            // Every row of tiles has its own generator, so the result does not depend on how the rows are spread over threads
+            Random random(stepSeed ^ Random::Hash((uint32_t)tileY));
+            int rowEnd = std::min((tileY + 1) * coralTileSize, Height);
+
+            for (int y = tileY * coralTileSize; y < rowEnd; y++)
+            {
+                // Deeper is better for coral, and above the substrate nothing settles
+                int depthPercent = y < substrateTop ? 0 : 50 + 50 * (y - substrateTop) / std::max(Height - substrateTop, 1);
+                const uint8_t* above = y > 0 ? current + (y - 1) * Width : nullptr;
+                const uint8_t* row = current + y * Width;
+                const uint8_t* below = y + 1 < Height ? current + (y + 1) * Width : nullptr;
+                uint8_t* nextRow = next + y * Width;
+
+                for (int x = 0; x < Width; x++)
+                {
+                    int density = row[x];
+                    uint32_t chance = random.Next() & 0xffff;
+
+                    if (density == 0)
+                    {
+                        int neighbours = 0;
+                        int left = std::max(x - 1, 0);
+                        int right = std::min(x + 1, Width - 1);
+                        for (int nx = left; nx <= right; nx++)
+                            neighbours += (above && above[nx]) + (below && below[nx]) + (nx != x && row[nx]);
+
+                        int spread = neighbours > 0 ? spreadChance * neighbours / 8 : settleChance;
+                        if ((int)chance < spread * depthPercent / 100)
+                            density = newCoralDensity;
+                    }
+                    else if ((int)chance < decayChance)
+                    {
+                        density = std::max(density - decayAmount, 0);
+                    }
+                    else
+                    {
+                        density = std::min(density + thickening, 255);
+                    }
+
+                    nextRow[x] = (uint8_t)density;
+                }
+            }
+
+            // Compare after the fact, so only tiles that really changed are copied and uploaded
+            for (int tileX = 0; tileX < TilesX; tileX++)
+            {
+                int left = tileX * coralTileSize;
+                int width = std::min(coralTileSize, Width - left);
+                for (int y = tileY * coralTileSize; y < rowEnd; y++)
+                {
+                    if (std::memcmp(current + y * Width + left, next + y * Width + left, width) != 0)
+                    {
+                        TileVersions[tileY * TilesX + tileX] = generation;
+                        break;
+                    }
+                }
+            }
+        }
+    });
+}
+
+void CoralReef::Swap()
+{
+    Current = 1 - Current;
+}
+
+void CoralState::CopyFrom(const CoralReef& reef)
+{
+    if (Width != reef.Width || Height != reef.Height)
+    {
+        Width = reef.Width;
+        Height = reef.Height;
+        TilesX = reef.TilesX;
+        TilesY = reef.TilesY;
+        Cells.assign(Width * Height, 0);
+        TileVersions.assign(TilesX * TilesY, 0);
+    }
+
+    for (int tileY = 0; tileY < TilesY; tileY++)
+    {
+        for (int tileX = 0; tileX < TilesX; tileX++)
+        {
+            uint64_t version = reef.TileVersions[tileY * TilesX + tileX];
+            if (TileVersions[tileY * TilesX + tileX] != version)
+            {
+                CopyTile(tileX, tileY, reef.GetCells());
+                TileVersions[tileY * TilesX + tileX] = version;
+            }
+        }
+    }
+}
+
+void CoralState::CopyTile(int tileX, int tileY, const uint8_t* cells)
+{
+    int left = tileX * coralTileSize;
+    int width = std::min(coralTileSize, Width - left);
+    int rowEnd = std::min((tileY + 1) * coralTileSize, Height);
+    for (int y = tileY * coralTileSize; y < rowEnd; y++)
+        std::memcpy(&Cells[y * Width + left], cells + y * Width + left, width);
+}
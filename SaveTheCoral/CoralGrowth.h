@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+// Size of a coral cell in layout units, and of the square tiles of cells that changes are tracked in
+const int coralCellSize = 4;
+const int coralTileSize = 32;
+
+// Simulation steps per coral growth step
+const int coralStepInterval = 6;
+
+// Coral as a cellular automaton on a grid over reefRect. Every cell holds a density, 0 for open water. Coral grows
+// into empty cells next to it and thickens with the calcium carbonate in the water, and thins out and dies with
+// acidity and heat. Every tile records when it last changed, so copies of the grid only ever move changed tiles.
+struct CoralReef
+{
+    int Width = 0;
+    int Height = 0;
+    int TilesX = 0;
+    int TilesY = 0;
+
+    // Densities, double buffered like the molecules
+    std::vector<uint8_t> Cells[2];
+    int Current = 0;
+
+    // Generation each tile last changed in; generations only ever go up, also across Initialize
+    std::vector<uint64_t> TileVersions;
+    uint64_t Generation = 0;
+
+    // Clear the grid and settle the first coral near the bottom of the reef
+    void Initialize(uint32_t seed);
+
+    // Queue one growth step on the job system, one job per row of tiles; the seed and step make it deterministic.
+    // Growth, acidity and heat are 0 to 1.
+    // Until the handle is waited on only the current cells may be read; afterwards call Swap.
+    JobSystem::Handle Dispatch(JobSystem& jobs, uint32_t seed, uint64_t step, float growth, float acidity, float heat);
+    void Swap();
+
+    const uint8_t* GetCells() const
+    {
+        return Cells[Current].data();
+    }
+};
+
+// A copy of the coral grid that is brought up to date tile by tile
+struct CoralState
+{
+    int Width = 0;
+    int Height = 0;
+    int TilesX = 0;
+    int TilesY = 0;
+    std::vector<uint8_t> Cells;
+    std::vector<uint64_t> TileVersions;
+
+    // Copy the tiles that changed since the last copy
+    void CopyFrom(const CoralReef& reef);
+
+    void CopyTile(int tileX, int tileY, const uint8_t* cells);
+};
+
+extern CoralReef coralReef;
@@ -0,0 +1,141 @@
+#include "CoralHealth.h"
+#include "Simulation.h"
+#include "TemperatureField.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CORAL_HEALTH_SSE2
+#endif
+
+CoralHealth coralHealth;
+
+// Fraction of the way to the target a cell moves per step, on average
+const float baseHealthRate = 0.01f;
+
+// Smooth noise in [0, 1] from a lattice of random values with the given spacing in cells
+static float ValueNoise(uint32_t seed, float x, float y, float spacing)
+{
+    x /= spacing;
+    y /= spacing;
+    int x0 = (int)x;
+    int y0 = (int)y;
+    float fx = x - x0;
+    float fy = y - y0;
+    auto lattice = [seed](int lx, int ly) { return (Random::Hash(seed ^ Random::Hash((uint32_t)lx * 73856093u ^ (uint32_t)ly * 19349663u)) & 0xffff) / 65535.0f; };
+
+    float top = lattice(x0, y0) + (lattice(x0 + 1, y0) - lattice(x0, y0)) * fx;
+    float bottom = lattice(x0, y0 + 1) + (lattice(x0 + 1, y0 + 1) - lattice(x0, y0 + 1)) * fx;
+    return top + (bottom - top) * fy;
+}
+
+void CoralHealth::Initialize(uint32_t seed)
+{
+    Width = ((int)reefRect.width + coralHealthCellSize - 1) / coralHealthCellSize;
+    Height = ((int)reefRect.height + coralHealthCellSize - 1) / coralHealthCellSize;
+
+    // Pad to whole SIMD blocks, the padding is never shown
+    size_t count = ((size_t)Width * Height + 3) & ~(size_t)3;
+    Health.assign(count, 1.0f);
+    Sensitivity.assign(count, 0.0f);
+    Rate.assign(count, baseHealthRate);
+    HeatStress.assign(count, 0.0f);
+    HeatVersion = 0;
+    Quantized.assign(count, 255);
+    Version++;
+
+    for (int y = 0; y < Height; y++)
+    {
+        for (int x = 0; x < Width; x++)
+        {
+            // Currents wash over some coral more than others (how warm the water is comes from the temperature field)
+            float current = ValueNoise(seed, (float)x, (float)y, 6) - 0.5f;
+            float sensitivity = 1.0f + 0.5f * current;
+            Sensitivity[y * Width + x] = std::clamp(sensitivity, 0.3f, 1.5f);
+            Rate[y * Width + x] = baseHealthRate * (0.4f + 1.2f * ValueNoise(seed ^ 0x5eedu, (float)x, (float)y, 3));
+        }
+    }
+}
+
+void CoralHealth::Update(float acidity, const TemperatureField& temperature)
+{
+    // Acid and warm water stress the coral equally; the padding cells keep no heat
+    if (HeatVersion != temperature.Version)
+    {
+        for (int y = 0; y < Height; y++)
+        {
+            for (int x = 0; x < Width; x++)
+            {
+                float heat = temperature.Sample(reefRect.left + (x + 0.5f) * coralHealthCellSize, reefRect.top + (y + 0.5f) * coralHealthCellSize);
+                HeatStress[y * Width + x] = 0.5f * heat;
+            }
+        }
+        HeatVersion = temperature.Version;
+    }
+
+    size_t count = Health.size();
+    float* health = Health.data();
+    const float* heatStress = HeatStress.data();
+    const float* sensitivity = Sensitivity.data();
+    const float* rate = Rate.data();
+    uint8_t* quantized = Quantized.data();
+    bool changed = false;
+    size_t i = 0;
+
+#ifdef CORAL_HEALTH_SSE2
+    // Four cells at a time: target = 1 - clamp((acid + heat) * sensitivity), health += (target - health) * rate
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 acidStress = _mm_set1_ps(0.5f * acidity);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 stress = _mm_add_ps(acidStress, _mm_loadu_ps(heatStress + i));
+        __m128 damage = _mm_min_ps(_mm_max_ps(_mm_mul_ps(stress, _mm_loadu_ps(sensitivity + i)), zero), one);
+        __m128 target = _mm_sub_ps(one, damage);
+        __m128 value = _mm_loadu_ps(health + i);
+        value = _mm_add_ps(value, _mm_mul_ps(_mm_sub_ps(target, value), _mm_loadu_ps(rate + i)));
+        _mm_storeu_ps(health + i, value);
+
+        // Round to bytes and compare with the previous bytes, all four at once
+        __m128i bytes = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+        bytes = _mm_packs_epi32(bytes, bytes);
+        bytes = _mm_packus_epi16(bytes, bytes);
+        uint32_t packed = (uint32_t)_mm_cvtsi128_si32(bytes);
+        uint32_t previous;
+        std::memcpy(&previous, quantized + i, sizeof(previous));
+        if (packed != previous)
+        {
+            std::memcpy(quantized + i, &packed, sizeof(packed));
+            changed = true;
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        float target = 1.0f - std::min(std::max((0.5f * acidity + heatStress[i]) * sensitivity[i], 0.0f), 1.0f);
+        health[i] += (target - health[i]) * rate[i];
+        uint8_t value = (uint8_t)std::lrint(std::min(std::max(health[i], 0.0f), 1.0f) * 255.0f);
+        if (quantized[i] != value)
+        {
+            quantized[i] = value;
+            changed = true;
+        }
+    }
+
+    if (changed)
+        Version++;
+}
+
+void CoralHealthState::CopyFrom(const CoralHealth& health)
+{
+    if (Version == health.Version && Width == health.Width)
+        return;
+
+    Width = health.Width;
+    Height = health.Height;
+    Values.assign(health.Quantized.begin(), health.Quantized.begin() + (size_t)Width * Height);
+    Version = health.Version;
+}
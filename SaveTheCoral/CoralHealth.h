@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct TemperatureField;
+
+// Size of a health cell in layout units; the field is coarse and smoothed by the texture sampler
+const int coralHealthCellSize = 32;
+
+// Health of the coral over the reef, from 1 for healthy to 0 for fully bleached. Every cell moves towards a
+// target set by the acidity and by the water temperature where it is, but cells differ in how exposed they are
+// (strong currents bleach first) and in how fast they react, so bleaching comes in patches.
+struct CoralHealth
+{
+    int Width = 0;
+    int Height = 0;
+
+    std::vector<float> Health;
+    std::vector<float> Sensitivity;
+    std::vector<float> Rate;
+
+    // Stress per cell from the local water temperature, sampled again whenever the temperature field changes
+    std::vector<float> HeatStress;
+    uint64_t HeatVersion = 0;
+
+    // Health as bytes for the texture, and a version that changes whenever any of them does
+    std::vector<uint8_t> Quantized;
+    uint64_t Version = 0;
+
+    void Initialize(uint32_t seed);
+
+    // Move every cell towards its target for the given acidity from 0 (none) to 1 (bleaching everywhere), plus the
+    // heat where the cell is
+    void Update(float acidity, const TemperatureField& temperature);
+};
+
+// A copy of the quantized health for the renderer
+struct CoralHealthState
+{
+    int Width = 0;
+    int Height = 0;
+    std::vector<uint8_t> Values;
+    uint64_t Version = 0;
+
+    void CopyFrom(const CoralHealth& health);
+};
+
+extern CoralHealth coralHealth;
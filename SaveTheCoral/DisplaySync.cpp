@@ -0,0 +1,246 @@
+#include "DisplaySync.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// A keyframe every this many steps
+const int keyframeInterval = 30;
+
+// Encoded bytes per datagram, which keeps datagrams under a typical MTU
+const size_t maxDatagramPayload = 1200;
+
+// Size of the datagram header in front of the encoded bytes
+const size_t datagramHeaderSize = sizeof(sf::Uint32) + sizeof(sf::Uint8) + sizeof(sf::Uint64) + sizeof(double) + 2 * sizeof(sf::Uint16);
+
+// Followers render this far behind the newest step, so there is a step on either side to interpolate between
+const double interpolationDelay = 2.0 / 60.0;
+
+// Keyframes this many steps behind the newest step seen come from a leader that started over, not from a late datagram
+const uint64_t resyncSteps = 2 * keyframeInterval;
+
+// How much the clock offset estimate may creep up per datagram, to follow drift between the clocks
+const double clockDrift = 0.00001;
+
+bool DisplayLeader::Start(const std::string& destinations)
+{
+    size_t begin = 0;
+    while (begin < destinations.size())
+    {
+        size_t end = destinations.find(',', begin);
+        if (end == std::string::npos)
+            end = destinations.size();
+
+        std::string destination = destinations.substr(begin, end - begin);
+        begin = end + 1;
+
+        // Leave out entries without a valid port or a host that resolves
+        size_t colon = destination.rfind(':');
+        if (colon == std::string::npos)
+            continue;
+        std::string portText = destination.substr(colon + 1);
+        char* portEnd = nullptr;
+        long port = std::strtol(portText.c_str(), &portEnd, 10);
+        if (portText.empty() || *portEnd != '\0' || port < 1 || port > 65535)
+            continue;
+        sf::IpAddress address(destination.substr(0, colon));
+        if (address == sf::IpAddress::None)
+            continue;
+        followers.emplace_back(address, (unsigned short)port);
+    }
+
+    if (followers.empty())
+        return false;
+
+    socket.setBlocking(false);
+    running = true;
+    return true;
+}
+
+void DisplayLeader::Send(const SimulationSnapshot& snapshot, double time)
+{
+    if (!running || snapshot.Step == lastStep)
+        return;
+
+    // The simulation started over, so the followers need a keyframe to start over too
+    if (snapshot.Step < lastStep)
+    {
+        encoder.Reset();
+        stepsSinceKeyframe = 0;
+    }
+
+    encoder.Encode(snapshot, stepsSinceKeyframe == 0, encoded);
+    stepsSinceKeyframe = (stepsSinceKeyframe + 1) % keyframeInterval;
+
+    size_t fragmentCount = (encoded.size() + maxDatagramPayload - 1) / maxDatagramPayload;
+    for (size_t f = 0; f < fragmentCount; f++)
+    {
+        size_t begin = f * maxDatagramPayload;
+        size_t size = std::min(maxDatagramPayload, encoded.size() - begin);
+
+        sf::Packet packet;
+        packet << displaySyncMagic << displaySyncVersion;
+        packet << (sf::Uint64)snapshot.Step << time << (sf::Uint16)f << (sf::Uint16)fragmentCount;
+        packet.append(encoded.data() + begin, size);
+
+        for (const auto& follower : followers)
+            socket.send(packet, follower.first, follower.second);
+    }
+
+    lastStep = snapshot.Step;
+}
+
+bool DisplayFollower::Start(unsigned short port)
+{
+    if (socket.bind(port) != sf::Socket::Done)
+        return false;
+
+    socket.setBlocking(false);
+    running = true;
+    std::cout << "Following the display leader on UDP port " << port << std::endl;
+    return true;
+}
+
+void DisplayFollower::Poll()
+{
+    if (!running)
+        return;
+
+    sf::Packet packet;
+    sf::IpAddress sender;
+    unsigned short senderPort = 0;
+    while (socket.receive(packet, sender, senderPort) == sf::Socket::Done)
+    {
+        ReceivedDatagrams++;
+        Receive(packet);
+    }
+}
+
+void DisplayFollower::Receive(sf::Packet& packet)
+{
+    sf::Uint32 magic = 0;
+    sf::Uint8 version = 0;
+    sf::Uint64 step = 0;
+    double leaderTime = 0;
+    sf::Uint16 fragment = 0;
+    sf::Uint16 fragmentCount = 0;
+    if (!(packet >> magic >> version) || magic != displaySyncMagic || version != displaySyncVersion)
+        return;
+    if (!(packet >> step >> leaderTime >> fragment >> fragmentCount) || fragment >= fragmentCount)
+        return;
+
+    // A keyframe far behind the steps seen so far means the leader started over (relaunched, or restarted by a
+    // reload): forget its old run and follow the new one
+    bool keyframe = fragment == 0 && packet.getDataSize() > datagramHeaderSize &&
+        SnapshotDecoder::IsKeyframe((const uint8_t*)packet.getData() + datagramHeaderSize, packet.getDataSize() - datagramHeaderSize);
+    if (keyframe && step + resyncSteps < std::max(finishedStep, assemblingStep))
+        Resync();
+
+    // Late datagrams of a step that has already been finished or overtaken are of no use
+    if ((step <= finishedStep && hasFinishedStep) || step < assemblingStep)
+        return;
+    if (step != assemblingStep)
+    {
+        if (fragmentsReceived > 0)
+            LostSteps++;
+        assemblingStep = step;
+        assemblingTime = leaderTime;
+        fragmentsReceived = 0;
+        fragments.assign(fragmentCount, {});
+    }
+
+    // Track the clock offset; the smallest difference is the datagram with the least delay
+    double offset = clock.getElapsedTime().asSeconds() - leaderTime;
+    clockOffset = hasClockOffset ? std::min(clockOffset + clockDrift, offset) : offset;
+    hasClockOffset = true;
+
+    if (fragment >= fragments.size() || !fragments[fragment].empty() || packet.getDataSize() <= datagramHeaderSize)
+        return;
+
+    // The rest of the datagram is a piece of the encoded step
+    const uint8_t* data = (const uint8_t*)packet.getData();
+    fragments[fragment].assign(data + datagramHeaderSize, data + packet.getDataSize());
+
+    if (++fragmentsReceived == (int)fragments.size())
+        FinishStep();
+}
+
+void DisplayFollower::Resync()
+{
+    finishedStep = 0;
+    hasFinishedStep = false;
+    assemblingStep = 0;
+    fragmentsReceived = 0;
+    fragments.clear();
+    decoder.Reset();
+    history.clear();
+    hasClockOffset = false;
+}
+
+void DisplayFollower::FinishStep()
+{
+    finishedStep = assemblingStep;
+    hasFinishedStep = true;
+    fragmentsReceived = 0;
+
+    std::vector<uint8_t> encoded;
+    for (const std::vector<uint8_t>& fragment : fragments)
+        encoded.insert(encoded.end(), fragment.begin(), fragment.end());
+
+    // Deltas after a lost step cannot be decoded until the next keyframe
+    Frame frame;
+    frame.LeaderTime = assemblingTime;
+    if (!decoder.Decode(encoded.data(), encoded.size(), frame.Snapshot))
+    {
+        LostSteps++;
+        return;
+    }
+
+    history.push_back(std::move(frame));
+    while (history.size() > 4)
+        history.pop_front();
+}
+
+bool DisplayFollower::GetSnapshot(SimulationSnapshot& snapshot)
+{
+    if (history.empty())
+        return false;
+
+    // Show the moment of the leader's simulation every follower is showing right now
+    double renderTime = clock.getElapsedTime().asSeconds() - clockOffset - interpolationDelay;
+
+    size_t next = 0;
+    while (next < history.size() && history[next].LeaderTime < renderTime)
+        next++;
+
+    if (next == 0 || next == history.size())
+    {
+        snapshot = history[next == 0 ? 0 : history.size() - 1].Snapshot;
+        return true;
+    }
+
+    const Frame& a = history[next - 1];
+    const Frame& b = history[next];
+    float t = (float)((renderTime - a.LeaderTime) / std::max(b.LeaderTime - a.LeaderTime, 1e-6));
+
+    // The animals are sorted anew every step, so the same index is not the same animal and they are shown as they are
+    snapshot = b.Snapshot;
+    for (size_t s = 0; s < snapshot.Species.size() && s < a.Snapshot.Species.size(); s++)
+    {
+        const SimulationSnapshot::SpeciesState& from = a.Snapshot.Species[s];
+        SimulationSnapshot::SpeciesState& to = snapshot.Species[s];
+        to.Level = from.Level + (to.Level - from.Level) * t;
+
+        // Molecules that wrapped around the reef jump instead of crossing it
+        size_t count = std::min(from.X.size(), to.X.size());
+        for (size_t i = 0; i < count; i++)
+        {
+            if (std::abs(to.X[i] - from.X[i]) > reefRect.width / 2)
+                continue;
+            to.X[i] = from.X[i] + (to.X[i] - from.X[i]) * t;
+            to.Y[i] = from.Y[i] + (to.Y[i] - from.Y[i]) * t;
+        }
+    }
+    return true;
+}
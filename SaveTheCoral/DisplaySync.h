@@ -0,0 +1,81 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+#include "SimulationThread.h"
+#include "SnapshotCodec.h"
+
+// Identifies display sync datagrams
+const sf::Uint32 displaySyncMagic = 0x53544453; // "STDS"
+const sf::Uint8 displaySyncVersion = 3;
+
+// Runs the authoritative simulation and broadcasts every step to the followers over UDP. Steps are encoded with the
+// snapshot codec, with a keyframe now and then so followers that missed a datagram recover, and split into
+// datagrams small enough not to be fragmented.
+struct DisplayLeader
+{
+    // Destinations as "host:port,host:port,..."; entries with a host that does not resolve or an invalid port are left
+    // out, and false if none is left
+    bool Start(const std::string& destinations);
+
+    // Send the snapshot if it is a step that has not been sent yet; time is the leader's clock in seconds
+    void Send(const SimulationSnapshot& snapshot, double time);
+
+private:
+    sf::UdpSocket socket;
+    std::vector<std::pair<sf::IpAddress, unsigned short>> followers;
+    SnapshotEncoder encoder;
+    std::vector<uint8_t> encoded;
+    uint64_t lastStep = 0;
+    int stepsSinceKeyframe = 0;
+    bool running = false;
+};
+
+// Receives the leader's steps and renders them with interpolation, on the leader's clock so all followers show
+// the same moment of the simulation
+struct DisplayFollower
+{
+    uint64_t ReceivedDatagrams = 0;
+    uint64_t LostSteps = 0;
+
+    bool Start(unsigned short port);
+
+    // Drain the datagrams that arrived since the last call
+    void Poll();
+
+    // Interpolated state at the current time; returns false until the first step has arrived
+    bool GetSnapshot(SimulationSnapshot& snapshot);
+
+private:
+    struct Frame
+    {
+        double LeaderTime = 0;
+        SimulationSnapshot Snapshot;
+    };
+
+    void Receive(sf::Packet& packet);
+    void FinishStep();
+
+    // Start over, waiting for a keyframe
+    void Resync();
+
+    sf::UdpSocket socket;
+    sf::Clock clock;
+    SnapshotDecoder decoder;
+    std::deque<Frame> history;
+
+    uint64_t finishedStep = 0;
+    bool hasFinishedStep = false;
+    uint64_t assemblingStep = 0;
+    double assemblingTime = 0;
+    int fragmentsReceived = 0;
+    std::vector<std::vector<uint8_t>> fragments;
+
+    // Local clock minus leader clock, estimated from the fastest datagrams seen
+    double clockOffset = 0;
+    bool hasClockOffset = false;
+    bool running = false;
+};
@@ -0,0 +1,215 @@
+#include "Ensemble.h"
+#include "ChemistryGrid.h"
+#include "Simulation.h"
+#include "SpeciesConfig.h"
+#include "TemperatureField.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Typical fractions of the way to the balance per step: the carbon dioxide mixing down from the surface, the
+// reactions, and the water warming
+const float mixingRate = 0.00025f;
+const float reactionRate = 0.02f;
+const float warmingRate = 0.002f;
+
+// Spread of the members' parameters, as the standard deviation of their logarithm
+const float rateSpread = 0.4f;
+const float sensitivitySpread = 0.15f;
+const float exponentSpread = 0.25f;
+
+namespace
+{
+    // Roughly normally distributed, from the sum of four uniform numbers
+    float NextNormal(Random& random)
+    {
+        float sum = 0;
+        for (int i = 0; i < 4; i++)
+            sum += (random.Next() >> 8) * (1.0f / (1 << 24));
+        return (sum - 2) * 1.7320508f;
+    }
+
+    // Value at a fraction of the way through the counted members, linearly within the bin it falls in
+    float GetPercentile(const uint32_t* counts, uint32_t total, float fraction, float histogramMin, float binsPerUnit)
+    {
+        float target = fraction * total;
+        float counted = 0;
+        for (int bin = 0; bin < ensembleHistogramBins; bin++)
+        {
+            if (counts[bin] > 0 && counted + counts[bin] >= target)
+                return histogramMin + (bin + (target - counted) / counts[bin]) / binsPerUnit;
+            counted += counts[bin];
+        }
+        return histogramMin + ensembleHistogramBins / binsPerUnit;
+    }
+}
+
+bool ChemistryEnsemble::CaptureModels()
+{
+    // Any change to the species, their order, ranges, the control species or the reactions invalidates the members
+    uint32_t hash = GetSpeciesConfigHash(speciesConfig);
+    bool changed = models.size() != allSpecies.size() || hash != configHash;
+    configHash = hash;
+    models.resize(allSpecies.size());
+    inertLevels.resize(allSpecies.size());
+    for (size_t s = 0; s < allSpecies.size(); s++)
+    {
+        const VariableData& data = *allSpecies[s];
+        SpeciesModel& model = models[s];
+        model.Role = (int)s == speciesConfig.ControlSpecies ? Control : Inert;
+        model.Min = data.Min;
+        model.Range = data.GetRange();
+        model.HistogramMin = data.Min - 0.25f * model.Range;
+        model.BinsPerUnit = ensembleHistogramBins / (1.5f * std::max(model.Range, 1e-6f));
+        inertLevels[s] = data.Level;
+    }
+    for (const SpeciesConfig::Reaction& reaction : speciesConfig.Reactions)
+        models[reaction.Species].Role = reaction.Rises ? Rises : Falls;
+    if (waterTemperatureSpecies >= 0 && waterTemperatureSpecies != speciesConfig.ControlSpecies)
+        models[waterTemperatureSpecies].Role = Heat;
+
+    const VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    controlSpecies = speciesConfig.ControlSpecies;
+    surfaceLevel = chemistryGrid.SurfaceLevel;
+    settledTemperature = waterTemperatureField.GetSettledMean((surfaceLevel - control.Min) / control.GetRange());
+    return !changed;
+}
+
+float ChemistryEnsemble::GetBalance(int species, int member, float pollution) const
+{
+    const SpeciesModel& model = models[species];
+    size_t i = (size_t)species * MemberCount + member;
+    switch (model.Role)
+    {
+    case Control:
+        return surfaceLevel;
+    case Rises:
+        return model.Min + model.Range * std::pow(std::min(pollution * sensitivities[i], 1.0f), exponents[i]);
+    case Falls:
+        return model.Min + model.Range * (1 - std::pow(std::min(pollution * sensitivities[i], 1.0f), exponents[i]));
+    case Heat:
+        return model.Min + model.Range * sensitivities[i] * settledTemperature;
+    default:
+        return inertLevels[species];
+    }
+}
+
+void ChemistryEnsemble::Initialize(int memberCount, uint32_t seed)
+{
+    MemberCount = std::max(memberCount, 1);
+    ensembleSeed = seed;
+    CaptureModels();
+
+    size_t count = models.size() * MemberCount;
+    levels.resize(count);
+    rates.resize(count);
+    sensitivities.resize(count);
+    exponents.resize(count);
+    for (size_t s = 0; s < models.size(); s++)
+    {
+        float typicalRate = models[s].Role == Control ? mixingRate : models[s].Role == Heat ? warmingRate : reactionRate;
+        for (int member = 0; member < MemberCount; member++)
+        {
+            size_t i = s * MemberCount + member;
+            Random random(Random::Hash(seed ^ 0xe45eu) ^ Random::Hash((uint32_t)i));
+            rates[i] = std::min(typicalRate * std::exp(rateSpread * NextNormal(random)), 1.0f);
+            sensitivities[i] = std::exp(sensitivitySpread * NextNormal(random));
+            exponents[i] = std::exp(exponentSpread * NextNormal(random));
+        }
+    }
+
+    // Every member starts at its own balance
+    const VariableData& control = *allSpecies[controlSpecies];
+    float pollution = std::clamp((surfaceLevel - control.Min) / control.GetRange(), 0.0f, 1.0f);
+    for (size_t s = 0; s < models.size(); s++)
+    {
+        for (int member = 0; member < MemberCount; member++)
+            levels[s * MemberCount + member] = GetBalance((int)s, member, pollution);
+    }
+
+    int chunks = (MemberCount + ensembleChunkSize - 1) / ensembleChunkSize;
+    histograms.resize((size_t)chunks * models.size());
+    Bands.assign(models.size(), EnsembleBand());
+}
+
+JobSystem::Handle ChemistryEnsemble::Dispatch(JobSystem& jobs)
+{
+    if (!CaptureModels())
+        Initialize(MemberCount, ensembleSeed);
+
+    int chunks = (MemberCount + ensembleChunkSize - 1) / ensembleChunkSize;
+    return jobs.Dispatch(chunks, 1, [this](int begin, int end)
+    {
+        for (int chunk = begin; chunk < end; chunk++)
+            StepChunk(chunk);
+    });
+}
+
+void ChemistryEnsemble::StepChunk(int chunk)
+{
+    int begin = chunk * ensembleChunkSize;
+    int end = std::min(begin + ensembleChunkSize, MemberCount);
+    const SpeciesModel& control = models[controlSpecies];
+    const float* carbonDioxide = levels.data() + (size_t)controlSpecies * MemberCount;
+
+    // The carbon dioxide first, the other species react to it
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t s = 0; s < models.size(); s++)
+        {
+            const SpeciesModel& model = models[s];
+            if ((pass == 0) != (model.Role == Control))
+                continue;
+
+            float* level = levels.data() + s * MemberCount;
+            const float* rate = rates.data() + s * MemberCount;
+            Histogram& histogram = histograms[(size_t)chunk * models.size() + s];
+            std::memset(histogram.Counts, 0, sizeof(histogram.Counts));
+            double sum = 0;
+            for (int member = begin; member < end; member++)
+            {
+                if (model.Role != Inert)
+                {
+                    float pollution = std::clamp((carbonDioxide[member] - control.Min) / control.Range, 0.0f, 1.0f);
+                    level[member] += (GetBalance((int)s, member, pollution) - level[member]) * rate[member];
+                }
+                else
+                {
+                    level[member] = inertLevels[s];
+                }
+
+                int bin = (int)((level[member] - model.HistogramMin) * model.BinsPerUnit);
+                histogram.Counts[std::clamp(bin, 0, ensembleHistogramBins - 1)]++;
+                sum += level[member];
+            }
+            histogram.Sum = sum;
+        }
+    }
+}
+
+void ChemistryEnsemble::Finish()
+{
+    int chunks = (MemberCount + ensembleChunkSize - 1) / ensembleChunkSize;
+    uint32_t counts[ensembleHistogramBins];
+    for (size_t s = 0; s < models.size(); s++)
+    {
+        std::memset(counts, 0, sizeof(counts));
+        double sum = 0;
+        for (int chunk = 0; chunk < chunks; chunk++)
+        {
+            const Histogram& histogram = histograms[(size_t)chunk * models.size() + s];
+            for (int bin = 0; bin < ensembleHistogramBins; bin++)
+                counts[bin] += histogram.Counts[bin];
+            sum += histogram.Sum;
+        }
+
+        const SpeciesModel& model = models[s];
+        EnsembleBand& band = Bands[s];
+        band.Mean = (float)(sum / MemberCount);
+        band.Low = GetPercentile(counts, MemberCount, ensembleLowPercentile, model.HistogramMin, model.BinsPerUnit);
+        band.LowerQuartile = GetPercentile(counts, MemberCount, 0.25f, model.HistogramMin, model.BinsPerUnit);
+        band.Median = GetPercentile(counts, MemberCount, 0.5f, model.HistogramMin, model.BinsPerUnit);
+        band.UpperQuartile = GetPercentile(counts, MemberCount, 0.75f, model.HistogramMin, model.BinsPerUnit);
+        band.High = GetPercentile(counts, MemberCount, ensembleHighPercentile, model.HistogramMin, model.BinsPerUnit);
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+// Members updated per job chunk
+const int ensembleChunkSize = 512;
+
+// Bins per species of the histograms the members are counted into; they span the species' range plus a quarter on
+// either side, values beyond that count into the outer bins
+const int ensembleHistogramBins = 128;
+
+// Spread of the ensemble for one species after a step, in the species' own units
+struct EnsembleBand
+{
+    float Mean = 0;
+    float Low = 0;
+    float LowerQuartile = 0;
+    float Median = 0;
+    float UpperQuartile = 0;
+    float High = 0;
+};
+
+// Percentiles the Low and High of a band are at
+const float ensembleLowPercentile = 0.05f;
+const float ensembleHighPercentile = 0.95f;
+
+// How uncertain the chemistry is: many copies of a simple model of it, each with its own reaction strengths, rates
+// and warming, all following the carbon dioxide the user sets. Each member is one box of water: its carbon dioxide
+// mixes in from the surface, every species moves towards its balance for that carbon dioxide, and the water warms
+// towards where the temperature field would settle.
+//
+// Only the members' levels are kept from step to step. The spread is worked out by counting the members into a
+// histogram per species and job chunk, merging the histograms and reading the percentiles off the merged one, so the
+// members are never gathered or sorted.
+struct ChemistryEnsemble
+{
+    int MemberCount = 0;
+
+    // One band per species, in the order of allSpecies; filled by Finish
+    std::vector<EnsembleBand> Bands;
+
+    // Draw the members' parameters from the seed and start them at their balance for the carbon dioxide set now
+    void Initialize(int memberCount, uint32_t seed);
+
+    // Queue one step of every member for the carbon dioxide the user set; call Finish once the handle is done. The
+    // jobs only use what is captured here, so they can run alongside the simulation step.
+    JobSystem::Handle Dispatch(JobSystem& jobs);
+
+    // Merge the chunks' histograms into the bands
+    void Finish();
+
+private:
+    struct Histogram
+    {
+        uint32_t Counts[ensembleHistogramBins];
+        double Sum;
+    };
+
+    // What a species does in the model, as in the chemistry grid
+    enum SpeciesRole
+    {
+        Inert,
+        Control,
+        Rises,
+        Falls,
+        Heat
+    };
+
+    struct SpeciesModel
+    {
+        SpeciesRole Role;
+        float Min;
+        float Range;
+        float HistogramMin;
+        float BinsPerUnit;
+    };
+
+    // Take the species' roles and ranges as they are now; false if the species configuration changed and the members
+    // must start over
+    bool CaptureModels();
+    float GetBalance(int species, int member, float pollution) const;
+    void StepChunk(int chunk);
+
+    uint32_t ensembleSeed = 0;
+    uint32_t configHash = 0;
+    std::vector<SpeciesModel> models;
+    int controlSpecies = 0;
+
+    // Captured by Dispatch: the carbon dioxide at the surface, where the temperature settles for it, and the levels
+    // of the species the model leaves alone
+    float surfaceLevel = 0;
+    float settledTemperature = 0;
+    std::vector<float> inertLevels;
+
+    // Per species, member after member: the level, the fraction of the way to the balance per step, and the balance's
+    // curve: how strongly it follows the carbon dioxide (the share of it needed for the full effect is the inverse),
+    // and the power of the carbon dioxide it follows. For the water temperature the strength scales the warming.
+    std::vector<float> levels;
+    std::vector<float> rates;
+    std::vector<float> sensitivities;
+    std::vector<float> exponents;
+
+    // Per chunk and species
+    std::vector<Histogram> histograms;
+};
@@ -0,0 +1,341 @@
+#include "Fauna.h"
+#include "FlowField.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+
+Fauna reefFauna;
+
+// Animals moved per job chunk
+const int faunaChunkSize = 256;
+
+// Fish speeds in layout units per step, and the weights of the boid rules
+const float fishMinSpeed = 1.0f;
+const float fishMaxSpeed = 3.5f;
+const float fishSeparationDistance = 25;
+const float separationWeight = 4.0f;
+const float alignmentWeight = 0.05f;
+const float cohesionWeight = 0.002f;
+const float wanderWeight = 0.15f;
+
+// A fish in a dense school only heeds this many others
+const int maxFishNeighbors = 24;
+
+// Fish steer away from the surface and the seabed within this distance
+const float fishEdgeDistance = 50;
+const float fishEdgeSteering = 0.1f;
+
+// How much of the current fish are carried by, plankton drifts with all of it and jitters a little
+const float fishCurrentShare = 0.3f;
+const float planktonJitter = 0.4f;
+
+// Stress each kind takes without harm; beyond it health goes down at the damage rate times the excess,
+// below it health recovers at the recovery rate
+const float stressTolerance[FaunaKindCount] = { 0.5f, 0.35f };
+const float healthDamageRate = 0.003f;
+const float healthRecoveryRate = 0.001f;
+
+// Births per kind per step at most, as a fraction of the capacity
+const float birthRate = 1.0f / 300;
+
+void Fauna::Initialize(uint32_t seed)
+{
+    for (int buffer = 0; buffer < 2; buffer++)
+    {
+        X[buffer].clear();
+        Y[buffer].clear();
+        VelocityX[buffer].clear();
+        VelocityY[buffer].clear();
+        Health[buffer].clear();
+        Kind[buffer].clear();
+    }
+    Current = 0;
+
+    // Cells are at least the sight distance, and fit the reef exactly so the grid wraps like the reef does
+    gridWidth = std::max((int)(reefRect.width / fishSightDistance), 3);
+    gridHeight = std::max((int)(reefRect.height / fishSightDistance), 1);
+
+    Random random(seed ^ 0xf154u);
+    const int schoolCount = 6;
+    for (int school = 0; school < schoolCount; school++)
+    {
+        float centerX = reefRect.left + random.NextInt((int)reefRect.width);
+        float centerY = reefRect.top + reefRect.height * 0.2f + random.NextInt((int)(reefRect.height * 0.5f));
+        float heading = random.NextInt(6283) / 1000.0f;
+        for (int i = school; i < Capacity[FaunaFish]; i += schoolCount)
+        {
+            float x = centerX + random.NextInt(160) - 80;
+            float y = std::clamp(centerY + random.NextInt(160) - 80, reefRect.top, reefRect.top + reefRect.height);
+            Add(FaunaFish, x, y, std::cos(heading) * 2, std::sin(heading) * 2);
+        }
+    }
+    for (int i = 0; i < Capacity[FaunaPlankton]; i++)
+        Add(FaunaPlankton, reefRect.left + random.NextInt((int)reefRect.width), reefRect.top + random.NextInt((int)reefRect.height), 0, 0);
+}
+
+void Fauna::Add(FaunaKind kind, float x, float y, float velocityX, float velocityY)
+{
+    float wrappedX = std::fmod(x - reefRect.left, reefRect.width);
+    X[Current].push_back(reefRect.left + (wrappedX < 0 ? wrappedX + reefRect.width : wrappedX));
+    Y[Current].push_back(y);
+    VelocityX[Current].push_back(velocityX);
+    VelocityY[Current].push_back(velocityY);
+    Health[Current].push_back(1.0f);
+    Kind[Current].push_back(kind);
+}
+
+void Fauna::Sort()
+{
+    // Counting sort by kind and cell into the other buffer
+    int count = GetCount();
+    int cells = gridWidth * gridHeight;
+    cellStart.assign((size_t)FaunaKindCount * cells + 1, 0);
+    cellOf.resize(count);
+
+    float cellsPerUnitX = gridWidth / reefRect.width;
+    float cellsPerUnitY = gridHeight / reefRect.height;
+    for (int i = 0; i < count; i++)
+    {
+        int cellX = std::clamp((int)((X[Current][i] - reefRect.left) * cellsPerUnitX), 0, gridWidth - 1);
+        int cellY = std::clamp((int)((Y[Current][i] - reefRect.top) * cellsPerUnitY), 0, gridHeight - 1);
+        cellOf[i] = Kind[Current][i] * cells + cellY * gridWidth + cellX;
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (size_t key = 1; key < cellStart.size(); key++)
+        cellStart[key] += cellStart[key - 1];
+
+    int sorted = 1 - Current;
+    X[sorted].resize(count);
+    Y[sorted].resize(count);
+    VelocityX[sorted].resize(count);
+    VelocityY[sorted].resize(count);
+    Health[sorted].resize(count);
+    Kind[sorted].resize(count);
+
+    std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < count; i++)
+    {
+        int to = next[cellOf[i]]++;
+        X[sorted][to] = X[Current][i];
+        Y[sorted][to] = Y[Current][i];
+        VelocityX[sorted][to] = VelocityX[Current][i];
+        VelocityY[sorted][to] = VelocityY[Current][i];
+        Health[sorted][to] = Health[Current][i];
+        Kind[sorted][to] = Kind[Current][i];
+    }
+    Current = sorted;
+}
+
+JobSystem::Handle Fauna::Dispatch(JobSystem& jobs, uint32_t seed, uint64_t step, float stress, const FlowField& flow)
+{
+    Sort();
+
+    uint32_t stepSeed = Random::Hash(seed ^ Random::Hash((uint32_t)step) ^ Random::Hash((uint32_t)(step >> 32) + 0xfa));
+    return jobs.Dispatch(GetCount(), faunaChunkSize, [this, stepSeed, stress, &flow](int begin, int end)
+    {
+        Move(begin, end, stepSeed, stress, flow);
+    });
+}
+
+void Fauna::Move(int begin, int end, uint32_t seed, float stress, const FlowField& flow)
+{
+    const float* x = X[Current].data();
+    const float* y = Y[Current].data();
+    const float* velocityX = VelocityX[Current].data();
+    const float* velocityY = VelocityY[Current].data();
+    const float* health = Health[Current].data();
+    const uint8_t* kind = Kind[Current].data();
+    float* nextX = X[1 - Current].data();
+    float* nextY = Y[1 - Current].data();
+    float* nextVelocityX = VelocityX[1 - Current].data();
+    float* nextVelocityY = VelocityY[1 - Current].data();
+    float* nextHealth = Health[1 - Current].data();
+    uint8_t* nextKind = Kind[1 - Current].data();
+
+    float top = reefRect.top;
+    float bottom = reefRect.top + reefRect.height;
+    float width = reefRect.width;
+    float cellsPerUnitX = gridWidth / reefRect.width;
+    float cellsPerUnitY = gridHeight / reefRect.height;
+    const int* fishCells = cellStart.data() + FaunaFish * gridWidth * gridHeight;
+
+    for (int i = begin; i < end; i++)
+    {
+        // Every animal gets its own random numbers, so the chunking does not matter
+        Random random(seed ^ ((uint32_t)i * 0x9e3779b9u));
+        auto randomSigned = [&random]() { return (int)(random.Next() >> 8) * (2.0f / (1 << 24)) - 1.0f; };
+
+        float u, v;
+        flow.Sample(x[i], y[i], u, v);
+
+        float vx = velocityX[i];
+        float vy = velocityY[i];
+        float moveX, moveY;
+        if (kind[i] == FaunaFish)
+        {
+            int cellX = std::clamp((int)((x[i] - reefRect.left) * cellsPerUnitX), 0, gridWidth - 1);
+            int cellY = std::clamp((int)((y[i] - top) * cellsPerUnitY), 0, gridHeight - 1);
+
+            int neighbors = 0;
+            float alignX = 0, alignY = 0, centerX = 0, centerY = 0, separateX = 0, separateY = 0;
+            for (int dy = -1; dy <= 1 && neighbors < maxFishNeighbors; dy++)
+            {
+                int neighborY = cellY + dy;
+                if (neighborY < 0 || neighborY >= gridHeight)
+                    continue;
+                for (int dx = -1; dx <= 1 && neighbors < maxFishNeighbors; dx++)
+                {
+                    int neighborX = (cellX + dx + gridWidth) % gridWidth;
+                    int cell = neighborY * gridWidth + neighborX;
+                    for (int j = fishCells[cell]; j < fishCells[cell + 1] && neighbors < maxFishNeighbors; j++)
+                    {
+                        float offsetX = x[j] - x[i];
+                        float offsetY = y[j] - y[i];
+                        if (offsetX > width / 2)
+                            offsetX -= width;
+                        else if (offsetX < -width / 2)
+                            offsetX += width;
+                        float distanceSquared = offsetX * offsetX + offsetY * offsetY;
+                        if (j == i || distanceSquared > fishSightDistance * fishSightDistance)
+                            continue;
+
+                        neighbors++;
+                        alignX += velocityX[j];
+                        alignY += velocityY[j];
+                        centerX += offsetX;
+                        centerY += offsetY;
+                        if (distanceSquared < fishSeparationDistance * fishSeparationDistance && distanceSquared > 0)
+                        {
+                            separateX -= offsetX / distanceSquared;
+                            separateY -= offsetY / distanceSquared;
+                        }
+                    }
+                }
+            }
+
+            if (neighbors > 0)
+            {
+                vx += separationWeight * separateX + alignmentWeight * (alignX / neighbors - vx) + cohesionWeight * centerX / neighbors;
+                vy += separationWeight * separateY + alignmentWeight * (alignY / neighbors - vy) + cohesionWeight * centerY / neighbors;
+            }
+            vx += wanderWeight * randomSigned();
+            vy += wanderWeight * randomSigned();
+            if (y[i] < top + fishEdgeDistance)
+                vy += fishEdgeSteering;
+            else if (y[i] > bottom - fishEdgeDistance)
+                vy -= fishEdgeSteering;
+
+            float speed = std::sqrt(vx * vx + vy * vy);
+            float clampedSpeed = std::clamp(speed, fishMinSpeed, fishMaxSpeed);
+            if (speed > 0)
+            {
+                vx *= clampedSpeed / speed;
+                vy *= clampedSpeed / speed;
+            }
+            moveX = vx + u * fishCurrentShare;
+            moveY = vy + v * fishCurrentShare;
+        }
+        else
+        {
+            vx = u + planktonJitter * randomSigned();
+            vy = v + planktonJitter * randomSigned();
+            moveX = vx;
+            moveY = vy;
+        }
+
+        // Wrap around left and right, turn back at the surface and the seabed
+        float newX = x[i] + moveX;
+        float newY = y[i] + moveY;
+        if (newX < reefRect.left)
+            newX += width;
+        else if (newX >= reefRect.left + width)
+            newX -= width;
+        if (newY < top || newY > bottom)
+        {
+            newY = std::clamp(newY < top ? top + top - newY : bottom + bottom - newY, top, bottom);
+            vy = -vy;
+        }
+
+        float excess = stress - stressTolerance[kind[i]];
+        float change = excess > 0 ? -excess * healthDamageRate : healthRecoveryRate;
+
+        nextX[i] = newX;
+        nextY[i] = newY;
+        nextVelocityX[i] = vx;
+        nextVelocityY[i] = vy;
+        nextHealth[i] = std::clamp(health[i] + change, 0.0f, 1.0f);
+        nextKind[i] = kind[i];
+    }
+}
+
+void Fauna::Finish(uint32_t seed, uint64_t step, float stress)
+{
+    Current = 1 - Current;
+
+    // Remove the dead, keeping the order
+    int count = GetCount();
+    int kept = 0;
+    int kindCounts[FaunaKindCount] = {};
+    fishIndices.clear();
+    for (int i = 0; i < count; i++)
+    {
+        if (Health[Current][i] <= 0)
+            continue;
+
+        X[Current][kept] = X[Current][i];
+        Y[Current][kept] = Y[Current][i];
+        VelocityX[Current][kept] = VelocityX[Current][i];
+        VelocityY[Current][kept] = VelocityY[Current][i];
+        Health[Current][kept] = Health[Current][i];
+        Kind[Current][kept] = Kind[Current][i];
+        kindCounts[Kind[Current][i]]++;
+        if (Kind[Current][i] == FaunaFish)
+            fishIndices.push_back(kept);
+        kept++;
+    }
+    X[Current].resize(kept);
+    Y[Current].resize(kept);
+    VelocityX[Current].resize(kept);
+    VelocityY[Current].resize(kept);
+    Health[Current].resize(kept);
+    Kind[Current].resize(kept);
+
+    // Animals are born while there is room for them in water that suits them; fish next to another fish
+    Random random(Random::Hash(seed ^ Random::Hash((uint32_t)step) ^ 0xb0b0u));
+    for (int k = 0; k < FaunaKindCount; k++)
+    {
+        FaunaKind kind = (FaunaKind)k;
+        float suitability = 1 - std::clamp((stress - stressTolerance[kind]) / (1 - stressTolerance[kind]), 0.0f, 1.0f);
+        int room = (int)(Capacity[kind] * suitability) - kindCounts[kind];
+        int births = std::min(room, std::max((int)(Capacity[kind] * birthRate), 1));
+        for (int birth = 0; birth < births; birth++)
+        {
+            if (kind == FaunaFish && !fishIndices.empty())
+            {
+                // Across the reef the water wraps around, as it does for the moves
+                int parent = fishIndices[random.NextInt((int)fishIndices.size())];
+                float x = X[Current][parent] + random.NextInt(41) - 20;
+                if (x < reefRect.left)
+                    x += reefRect.width;
+                else if (x >= reefRect.left + reefRect.width)
+                    x -= reefRect.width;
+                Add(kind, x, std::clamp(Y[Current][parent] + random.NextInt(41) - 20, reefRect.top, reefRect.top + reefRect.height),
+                    VelocityX[Current][parent], VelocityY[Current][parent]);
+            }
+            else
+            {
+                Add(kind, reefRect.left + random.NextInt((int)reefRect.width), reefRect.top + random.NextInt((int)reefRect.height), 0, 0);
+            }
+        }
+    }
+}
+
+void FaunaState::CopyFrom(const Fauna& fauna)
+{
+    X = fauna.X[fauna.Current];
+    Y = fauna.Y[fauna.Current];
+    VelocityX = fauna.VelocityX[fauna.Current];
+    VelocityY = fauna.VelocityY[fauna.Current];
+    Health = fauna.Health[fauna.Current];
+    Kind = fauna.Kind[fauna.Current];
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+struct FlowField;
+
+// Kinds of reef animals
+enum FaunaKind : uint8_t
+{
+    FaunaFish = 0,
+    FaunaPlankton = 1,
+    FaunaKindCount = 2
+};
+
+// Distance up to which fish see each other, in layout units; the spatial grid cells are at least this size
+const float fishSightDistance = 60;
+
+// Reef animals as agents, with every field in its own array. Fish school by the boid rules (keep apart, swim along
+// with and stay close to the fish around them), finding those through a uniform grid so each fish only looks at
+// the cells next to its own. Plankton drifts with the current. Acid and warm water wear the animals' health down:
+// animals without health die, and new ones are born while the water suits them, up to a capacity per kind.
+struct Fauna
+{
+    // Double buffered: every step the animals are sorted by kind and grid cell into the other buffer, so the animals
+    // of one cell are next to each other, and then moved from there back into the first
+    std::vector<float> X[2];
+    std::vector<float> Y[2];
+    std::vector<float> VelocityX[2];
+    std::vector<float> VelocityY[2];
+    std::vector<float> Health[2];
+    std::vector<uint8_t> Kind[2];
+    int Current = 0;
+
+    // Most animals of each kind
+    int Capacity[FaunaKindCount] = { 600, 3000 };
+
+    // Start over with every kind at its capacity, the fish in a few schools
+    void Initialize(uint32_t seed);
+
+    int GetCount() const
+    {
+        return (int)X[Current].size();
+    }
+
+    // Sort the animals into the grid and queue their moves on the job system; the seed and step make it
+    // deterministic. Stress is how bad the water is, 0 to 1. Until the handle is waited on only the current buffers
+    // may be read and the flow must not change; afterwards call Finish.
+    JobSystem::Handle Dispatch(JobSystem& jobs, uint32_t seed, uint64_t step, float stress, const FlowField& flow);
+
+    // Make the moved animals current, then remove the dead and add the newborn
+    void Finish(uint32_t seed, uint64_t step, float stress);
+
+private:
+    void Sort();
+    void Move(int begin, int end, uint32_t seed, float stress, const FlowField& flow);
+    void Add(FaunaKind kind, float x, float y, float velocityX, float velocityY);
+
+    int gridWidth = 0;
+    int gridHeight = 0;
+
+    // Index of the first animal of every kind and cell in the sorted buffer, kind major, plus the end
+    std::vector<int> cellStart;
+    std::vector<int> cellOf;
+
+    // The surviving fish, for the newborn fish to start next to
+    std::vector<int> fishIndices;
+};
+
+// A copy of the animals for the renderer
+struct FaunaState
+{
+    std::vector<float> X;
+    std::vector<float> Y;
+    std::vector<float> VelocityX;
+    std::vector<float> VelocityY;
+    std::vector<float> Health;
+    std::vector<uint8_t> Kind;
+
+    void CopyFrom(const Fauna& fauna);
+};
+
+extern Fauna reefFauna;
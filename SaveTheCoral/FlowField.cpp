@@ -0,0 +1,266 @@
+#include "FlowField.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+
+FlowField oceanFlow;
+
+// Speed of the drift along the surface and of the eddies, in layout units per step
+const float surfaceCurrent = 1.2f;
+const float eddySpeed = 0.8f;
+const int eddyCount = 3;
+
+// Fraction of the way to the driving current the field moves per step
+const float forceRate = 0.02f;
+
+// Pressure solver iterations per step; the pressure of the last step is a good start, so few are needed
+const int pressureIterations = 30;
+
+namespace
+{
+    // A wave in the stream function: it travels left or right, and its vertical shape keeps it off the walls
+    struct Eddy
+    {
+        int WavesX;
+        int WavesY;
+        float Phase;
+        float AngularSpeed;
+        float Amplitude;
+    };
+
+    void GetEddies(uint32_t seed, int height, Eddy (&eddies)[eddyCount])
+    {
+        Random random(seed ^ 0xedd1e5u);
+        for (Eddy& eddy : eddies)
+        {
+            eddy.WavesX = 1 + random.NextInt(3);
+            eddy.WavesY = 1 + random.NextInt(2);
+            eddy.Phase = random.NextInt(6283) / 1000.0f;
+
+            // Between 20 and 60 seconds per period at 60 steps per second, either way
+            float period = (20 + random.NextInt(40)) * 60.0f;
+            eddy.AngularSpeed = (random.Next() & 1 ? 1 : -1) * 6.2831853f / period;
+
+            // Scaled so the flow of the wave peaks at eddySpeed
+            eddy.Amplitude = eddySpeed / (3.1415927f * eddy.WavesY / height);
+        }
+    }
+
+    // Bilinear lookup in a grid that wraps left and right and is clamped at the top and bottom, in cell coordinates
+    float SampleGrid(const float* grid, int width, int height, float x, float y)
+    {
+        float floorX = std::floor(x);
+        int x0 = (int)floorX;
+        float tx = x - floorX;
+        x0 %= width;
+        if (x0 < 0)
+            x0 += width;
+        int x1 = x0 + 1 == width ? 0 : x0 + 1;
+
+        y = std::clamp(y, 0.0f, (float)(height - 1));
+        int y0 = std::min((int)y, height - 2);
+        float ty = y - y0;
+
+        const float* row0 = grid + y0 * width;
+        const float* row1 = row0 + width;
+        float top = row0[x0] + (row0[x1] - row0[x0]) * tx;
+        float bottom = row1[x0] + (row1[x1] - row1[x0]) * tx;
+        return top + (bottom - top) * ty;
+    }
+}
+
+// The current the field is driven towards, in layout units per step
+static void GetDrivingCurrent(uint32_t seed, uint64_t step, int width, int height, std::vector<float>& u, std::vector<float>& v)
+{
+    Eddy eddies[eddyCount];
+    GetEddies(seed, height, eddies);
+
+    u.resize((size_t)width * height);
+    v.resize((size_t)width * height);
+    for (int y = 0; y < height; y++)
+    {
+        // Drift strongest at the surface, gone at the seabed
+        float depth = (y + 0.5f) / height;
+        float drift = surfaceCurrent * (1 - depth) * (1 - depth);
+        std::fill(u.begin() + y * width, u.begin() + (y + 1) * width, drift);
+        std::fill(v.begin() + y * width, v.begin() + (y + 1) * width, 0.0f);
+    }
+
+    // The eddies are the curl of a stream function sin(kx x + phase) sin(ky y), so they add no divergence and no
+    // flow through the walls
+    std::vector<float> waveX(width);
+    std::vector<float> slopeX(width);
+    for (const Eddy& eddy : eddies)
+    {
+        float kx = 6.2831853f * eddy.WavesX / width;
+        float ky = 3.1415927f * eddy.WavesY / height;
+        float phase = eddy.Phase + (float)std::fmod(eddy.AngularSpeed * (double)step, 6.283185307179586);
+        for (int x = 0; x < width; x++)
+        {
+            waveX[x] = std::sin(kx * (x + 0.5f) + phase);
+            slopeX[x] = std::cos(kx * (x + 0.5f) + phase) * kx;
+        }
+        for (int y = 0; y < height; y++)
+        {
+            float waveY = std::sin(ky * (y + 0.5f)) * eddy.Amplitude;
+            float slopeY = std::cos(ky * (y + 0.5f)) * ky * eddy.Amplitude;
+            float* rowU = u.data() + y * width;
+            float* rowV = v.data() + y * width;
+            for (int x = 0; x < width; x++)
+            {
+                rowU[x] += waveX[x] * slopeY;
+                rowV[x] -= slopeX[x] * waveY;
+            }
+        }
+    }
+}
+
+void FlowField::Initialize(uint32_t seed)
+{
+    Width = std::max((int)std::lround(reefRect.width / flowCellSize), 2);
+    Height = std::max((int)std::lround(reefRect.height / flowCellSize), 2);
+    cellsPerUnitX = Width / reefRect.width;
+    cellsPerUnitY = Height / reefRect.height;
+    pressure.assign((size_t)Width * Height, 0.0f);
+    nextPressure.assign((size_t)Width * Height, 0.0f);
+    divergence.assign((size_t)Width * Height, 0.0f);
+
+    // Start with the currents already flowing
+    Current = 0;
+    GetDrivingCurrent(seed, 0, Width, Height, U[0], V[0]);
+    U[1] = U[0];
+    V[1] = V[0];
+}
+
+JobSystem::Handle FlowField::Dispatch(JobSystem& jobs, uint32_t seed, uint64_t step)
+{
+    // The grid is small enough that one job solves it well within the time the molecule jobs take
+    return jobs.Dispatch(1, 1, [this, seed, step](int, int)
+    {
+        Solve(seed, step);
+    });
+}
+
+void FlowField::Swap()
+{
+    Current = 1 - Current;
+}
+
+void FlowField::Solve(uint32_t seed, uint64_t step)
+{
+    const float* currentU = U[Current].data();
+    const float* currentV = V[Current].data();
+    float* nextU = U[1 - Current].data();
+    float* nextV = V[1 - Current].data();
+
+    // Carry the velocity along with itself, looking back along it from every cell, and pull it towards the drive
+    GetDrivingCurrent(seed, step, Width, Height, driveU, driveV);
+    float cellWidth = reefRect.width / Width;
+    float cellHeight = reefRect.height / Height;
+    for (int y = 0; y < Height; y++)
+    {
+        for (int x = 0; x < Width; x++)
+        {
+            int i = y * Width + x;
+            float fromX = x - currentU[i] / cellWidth;
+            float fromY = y - currentV[i] / cellHeight;
+            float u = SampleGrid(currentU, Width, Height, fromX, fromY);
+            float v = SampleGrid(currentV, Width, Height, fromX, fromY);
+            nextU[i] = u + (driveU[i] - u) * forceRate;
+            nextV[i] = v + (driveV[i] - v) * forceRate;
+        }
+    }
+
+    // Remove the divergence: solve for the pressure whose gradient it is, by Jacobi iteration, and subtract that.
+    // Nothing flows through the walls, beyond them v is mirrored and the pressure repeats.
+    for (int y = 0; y < Height; y++)
+    {
+        float* row = divergence.data() + y * Width;
+        const float* rowU = nextU + y * Width;
+        const float* above = nextV + std::max(y - 1, 0) * Width;
+        const float* here = nextV + y * Width;
+        const float* below = nextV + std::min(y + 1, Height - 1) * Width;
+        float aboveSign = y > 0 ? 1.0f : -1.0f;
+        float belowSign = y < Height - 1 ? 1.0f : -1.0f;
+        for (int x = 0; x < Width; x++)
+        {
+            int left = x == 0 ? Width - 1 : x - 1;
+            int right = x == Width - 1 ? 0 : x + 1;
+            float verticalAbove = y > 0 ? above[x] : here[x];
+            float verticalBelow = y < Height - 1 ? below[x] : here[x];
+            row[x] = 0.5f * ((rowU[right] - rowU[left]) / cellWidth + (belowSign * verticalBelow - aboveSign * verticalAbove) / cellHeight);
+        }
+    }
+
+    for (int iteration = 0; iteration < pressureIterations; iteration++)
+    {
+        for (int y = 0; y < Height; y++)
+        {
+            const float* above = pressure.data() + std::max(y - 1, 0) * Width;
+            const float* here = pressure.data() + y * Width;
+            const float* below = pressure.data() + std::min(y + 1, Height - 1) * Width;
+            const float* rowDivergence = divergence.data() + y * Width;
+            float* out = nextPressure.data() + y * Width;
+
+            // The edge columns wrap, the columns in between vectorize
+            out[0] = 0.25f * (here[Width - 1] + here[1] + above[0] + below[0] - rowDivergence[0]);
+            for (int x = 1; x < Width - 1; x++)
+                out[x] = 0.25f * (here[x - 1] + here[x + 1] + above[x] + below[x] - rowDivergence[x]);
+            out[Width - 1] = 0.25f * (here[Width - 2] + here[0] + above[Width - 1] + below[Width - 1] - rowDivergence[Width - 1]);
+        }
+        pressure.swap(nextPressure);
+    }
+
+    for (int y = 0; y < Height; y++)
+    {
+        const float* above = pressure.data() + std::max(y - 1, 0) * Width;
+        const float* here = pressure.data() + y * Width;
+        const float* below = pressure.data() + std::min(y + 1, Height - 1) * Width;
+        float* rowU = nextU + y * Width;
+        float* rowV = nextV + y * Width;
+        for (int x = 0; x < Width; x++)
+        {
+            int left = x == 0 ? Width - 1 : x - 1;
+            int right = x == Width - 1 ? 0 : x + 1;
+            rowU[x] -= 0.5f * (here[right] - here[left]) * cellWidth;
+            rowV[x] -= 0.5f * (below[x] - above[x]) * cellHeight;
+        }
+    }
+}
+
+void FlowField::Sample(float x, float y, float& u, float& v) const
+{
+    if (Width == 0)
+    {
+        u = v = 0;
+        return;
+    }
+
+    // Same lookup as SampleGrid, for both components at once and without the divisions; molecules are always on
+    // the reef, so the cell is at most one off the grid
+    float cellX = (x - reefRect.left) * cellsPerUnitX - 0.5f;
+    float cellY = std::clamp((y - reefRect.top) * cellsPerUnitY - 0.5f, 0.0f, (float)(Height - 1));
+    int x0 = (int)(cellX + 1.0f) - 1;
+    int y0 = std::min((int)cellY, Height - 2);
+    float tx = cellX - x0;
+    float ty = cellY - y0;
+    if (x0 < 0)
+        x0 += Width;
+    else if (x0 >= Width)
+        x0 -= Width;
+    int x1 = x0 + 1 == Width ? 0 : x0 + 1;
+
+    int i00 = y0 * Width + x0;
+    int i01 = y0 * Width + x1;
+    int i10 = i00 + Width;
+    int i11 = i01 + Width;
+    float w00 = (1 - tx) * (1 - ty);
+    float w01 = tx * (1 - ty);
+    float w10 = (1 - tx) * ty;
+    float w11 = tx * ty;
+
+    const float* gridU = U[Current].data();
+    const float* gridV = V[Current].data();
+    u = gridU[i00] * w00 + gridU[i01] * w01 + gridU[i10] * w10 + gridU[i11] * w11;
+    v = gridV[i00] * w00 + gridV[i01] * w01 + gridV[i10] * w10 + gridV[i11] * w11;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+// Size of a flow cell in layout units; currents vary slowly, so the grid is coarse
+const float flowCellSize = 40;
+
+// Ocean currents over reefRect as a velocity field on a coarse grid, in layout units per simulation step, solved
+// stable fluids style: the current is driven towards a drift along the surface plus slowly wandering eddies, carried
+// along by itself, and made divergence free so molecules neither bunch up nor thin out. The field wraps around
+// left and right, the surface and the seabed are walls.
+struct FlowField
+{
+    int Width = 0;
+    int Height = 0;
+
+    // Velocities at the cell centers, double buffered like the molecules
+    std::vector<float> U[2];
+    std::vector<float> V[2];
+    int Current = 0;
+
+    void Initialize(uint32_t seed);
+
+    // Queue one solver step on the job system; the seed and step make it deterministic.
+    // Until the handle is waited on only the current velocities may be read; afterwards call Swap.
+    JobSystem::Handle Dispatch(JobSystem& jobs, uint32_t seed, uint64_t step);
+    void Swap();
+
+    // Velocity at a position in layout units, interpolated between the cell centers; zero before Initialize
+    void Sample(float x, float y, float& u, float& v) const;
+
+private:
+    void Solve(uint32_t seed, uint64_t step);
+
+    float cellsPerUnitX = 0;
+    float cellsPerUnitY = 0;
+
+    // Solver scratch, pressure is kept from step to step as the starting point of the next solve
+    std::vector<float> pressure;
+    std::vector<float> nextPressure;
+    std::vector<float> divergence;
+    std::vector<float> driveU;
+    std::vector<float> driveV;
+};
+
+extern FlowField oceanFlow;
@@ -0,0 +1,118 @@
+#include "FrameGovernor.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <filesystem>
+#endif
+
+const float minRenderScale = 0.5f;
+const float renderScaleStep = 0.1f;
+const float minMoleculeDensity = 0.25f;
+const float moleculeDensityStep = 0.25f;
+const int maxDetailLevel = 2;
+
+// Seconds to wait after an adjustment before judging its effect
+const float adjustmentDelay = 1.0f;
+
+// Targets outside this range (or not a number) are taken as the nearest end of it
+const float minTargetFps = 1.0f;
+const float maxTargetFps = 1000.0f;
+
+void FrameGovernor::SetTargetFps(float fps)
+{
+    fps = fps >= minTargetFps ? std::min(fps, maxTargetFps) : minTargetFps;
+    TargetFrameTime = 1.0f / fps;
+}
+
+bool FrameGovernor::Update(float frameTime)
+{
+    AverageFrameTime += (frameTime - AverageFrameTime) * 0.05f;
+
+    // Give each change a moment to show its effect before making another one
+    if (adjustmentClock.getElapsedTime().asSeconds() < adjustmentDelay)
+        return false;
+
+    bool changed = false;
+    if (AverageFrameTime > TargetFrameTime)
+    {
+        changed = Degrade();
+        if (changed)
+            Log("over");
+    }
+    else if (AverageFrameTime < TargetFrameTime * 0.6f)
+    {
+        changed = Improve();
+        if (changed)
+            Log("under");
+    }
+
+    if (changed)
+        adjustmentClock.restart();
+
+    return changed;
+}
+
+bool FrameGovernor::Degrade()
+{
+    // Cheapest visual loss first: simpler molecule shapes, then resolution, then fewer molecules
+    if (DetailLevel < maxDetailLevel)
+        DetailLevel++;
+    else if (RenderScale > minRenderScale)
+        RenderScale = std::max(RenderScale - renderScaleStep, minRenderScale);
+    else if (MoleculeDensity > minMoleculeDensity)
+        MoleculeDensity = std::max(MoleculeDensity - moleculeDensityStep, minMoleculeDensity);
+    else
+        return false;
+
+    return true;
+}
+
+bool FrameGovernor::Improve()
+{
+    // Restore in the reverse order of degrading
+    if (MoleculeDensity < 1.0f)
+        MoleculeDensity = std::min(MoleculeDensity + moleculeDensityStep, 1.0f);
+    else if (RenderScale < 1.0f)
+        RenderScale = std::min(RenderScale + renderScaleStep, 1.0f);
+    else if (DetailLevel > 0)
+        DetailLevel--;
+    else
+        return false;
+
+    return true;
+}
+
+void FrameGovernor::Log(const char* direction) const
+{
+    std::cout << "Frame governor: " << AverageFrameTime * 1000 << " ms per frame is " << direction << " the " << TargetFrameTime * 1000 << " ms budget;"
+              << " detail level " << DetailLevel << ", render scale " << RenderScale << ", molecule density " << MoleculeDensity << std::endl;
+}
+
+bool IsRunningOnBattery()
+{
+#ifdef _WIN32
+    SYSTEM_POWER_STATUS status;
+    return GetSystemPowerStatus(&status) && status.ACLineStatus == 0;
+#else
+    // Look for a mains power supply that reports being offline
+    std::error_code error;
+    for (const auto& supply : std::filesystem::directory_iterator("/sys/class/power_supply", error))
+    {
+        std::string type;
+        std::ifstream(supply.path() / "type") >> type;
+        if (type != "Mains")
+            continue;
+
+        int online = 1;
+        std::ifstream(supply.path() / "online") >> online;
+        if (online == 0)
+            return true;
+    }
+    return false;
+#endif
+}
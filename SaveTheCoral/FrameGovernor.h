@@ -0,0 +1,29 @@
+#pragma once
+#include <SFML/System/Clock.hpp>
+
+// Keeps the frame time within a budget by trading visual quality for speed, one step at a time
+struct FrameGovernor
+{
+    // What the governor can adjust, from full quality down to the cheapest settings
+    float RenderScale = 1.0f;
+    float MoleculeDensity = 1.0f;
+    int DetailLevel = 0;
+
+    float TargetFrameTime = 1.0f / 60.0f;
+    float AverageFrameTime = 0;
+
+    void SetTargetFps(float fps);
+
+    // Feed in the time spent on the last frame; returns true if any of the settings changed
+    bool Update(float frameTime);
+
+private:
+    bool Degrade();
+    bool Improve();
+    void Log(const char* direction) const;
+
+    sf::Clock adjustmentClock;
+};
+
+// Whether the machine is running without mains power, in which case a lower frame rate is targeted
+bool IsRunningOnBattery();
@@ -0,0 +1,143 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+JobSystem::JobSystem(int workerCount)
+{
+    // There is always at least one queue, so that chunks dispatched without workers can be run by Wait
+    int queueCount = std::max(workerCount, 1);
+    for (int i = 0; i < queueCount; i++)
+        queues.push_back(std::make_unique<WorkerQueue>());
+
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+JobSystem::Handle JobSystem::Dispatch(int count, int chunkSize, std::function<void(int begin, int end)> job)
+{
+    Handle batch = std::make_shared<Batch>();
+    batch->Job = std::move(job);
+
+    chunkSize = std::max(chunkSize, 1);
+    int chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (chunkCount <= 0)
+        return batch;
+    batch->Remaining = chunkCount;
+
+    // Deal the chunks out round-robin so every worker starts with its own share
+    unsigned int queue = nextQueue++;
+    for (int begin = 0; begin < count; begin += chunkSize)
+    {
+        WorkerQueue& workerQueue = *queues[queue++ % queues.size()];
+        std::lock_guard<std::mutex> lock(workerQueue.Mutex);
+        workerQueue.Tasks.push_back({ batch, begin, std::min(begin + chunkSize, count) });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        pendingTasks += chunkCount;
+    }
+    wakeUp.notify_all();
+
+    return batch;
+}
+
+void JobSystem::Wait(const Handle& handle)
+{
+    Task task;
+    while (handle->Remaining > 0)
+    {
+        if (StealTask(-1, task))
+            RunTask(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::ParallelFor(int count, int chunkSize, std::function<void(int begin, int end)> job)
+{
+    Wait(Dispatch(count, chunkSize, std::move(job)));
+}
+
+int JobSystem::GetWorkerCount() const
+{
+    return (int)workers.size();
+}
+
+int JobSystem::GetDefaultWorkerCount()
+{
+    return std::max((int)std::thread::hardware_concurrency() - 1, 0);
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+    Task task;
+    while (true)
+    {
+        if (PopTask(index, task) || StealTask(index, task))
+        {
+            RunTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return stopping || pendingTasks > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+bool JobSystem::PopTask(int index, Task& task)
+{
+    // Own work is taken from the back, the most recently queued chunks are the most likely to be in cache
+    WorkerQueue& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.Mutex);
+    if (queue.Tasks.empty())
+        return false;
+
+    task = std::move(queue.Tasks.back());
+    queue.Tasks.pop_back();
+    pendingTasks--;
+    return true;
+}
+
+bool JobSystem::StealTask(int index, Task& task)
+{
+    // Other queues are robbed from the front, away from where their owner is working
+    int queueCount = (int)queues.size();
+    for (int offset = 1; offset <= queueCount; offset++)
+    {
+        int victim = (std::max(index, 0) + offset) % queueCount;
+        if (victim == index)
+            continue;
+
+        WorkerQueue& queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.Mutex);
+        if (queue.Tasks.empty())
+            continue;
+
+        task = std::move(queue.Tasks.front());
+        queue.Tasks.pop_front();
+        pendingTasks--;
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::RunTask(Task& task)
+{
+    task.Batch->Job(task.Begin, task.End);
+    task.Batch->Remaining--;
+    task.Batch.reset();
+}
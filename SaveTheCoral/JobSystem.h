@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads running chunked parallel-for jobs. Every worker has its own queue of chunks and
+// steals from the others when it runs dry; threads waiting on a batch help out instead of blocking.
+struct JobSystem
+{
+    // A job split into chunks; it is done when no chunk remains
+    struct Batch
+    {
+        std::function<void(int begin, int end)> Job;
+        std::atomic<int> Remaining{ 0 };
+    };
+    using Handle = std::shared_ptr<Batch>;
+
+    // With a worker count of 0 the calling thread does all the work in Wait
+    explicit JobSystem(int workerCount);
+    ~JobSystem();
+
+    // Split [0, count) into chunks of chunkSize and queue them; returns immediately
+    Handle Dispatch(int count, int chunkSize, std::function<void(int begin, int end)> job);
+
+    // Run queued chunks on the calling thread until the batch is done
+    void Wait(const Handle& handle);
+
+    void ParallelFor(int count, int chunkSize, std::function<void(int begin, int end)> job);
+
+    int GetWorkerCount() const;
+
+    // One worker per core, leaving a core for the main thread
+    static int GetDefaultWorkerCount();
+
+private:
+    struct Task
+    {
+        Handle Batch;
+        int Begin = 0;
+        int End = 0;
+    };
+
+    struct WorkerQueue
+    {
+        std::mutex Mutex;
+        std::deque<Task> Tasks;
+    };
+
+    void WorkerLoop(int index);
+    bool PopTask(int index, Task& task);
+    bool StealTask(int index, Task& task);
+    void RunTask(Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> pendingTasks{ 0 };
+    std::atomic<unsigned int> nextQueue{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
@@ -0,0 +1,157 @@
+#include "LevelHistory.h"
+#include <algorithm>
+#include <limits>
+
+// Skipped steps filled in at most, so a long gap costs little
+const uint64_t maxFilledSteps = 600;
+
+void MinMaxHistory::Clear()
+{
+    for (Level& level : levels)
+    {
+        level.Buckets.assign(historyCapacity, Bucket{ 0, 0 });
+        level.Count = 0;
+        level.PendingCount = 0;
+    }
+    count = 0;
+}
+
+void MinMaxHistory::Add(float value)
+{
+    if (levels[0].Buckets.empty())
+        Clear();
+
+    // Into the bucket being filled at every resolution, and full buckets into their ring buffer
+    count++;
+    uint64_t bucketSize = 1;
+    for (Level& level : levels)
+    {
+        if (level.PendingCount == 0)
+        {
+            level.Pending = { value, value };
+        }
+        else
+        {
+            level.Pending.Min = std::min(level.Pending.Min, value);
+            level.Pending.Max = std::max(level.Pending.Max, value);
+        }
+
+        if (++level.PendingCount == bucketSize)
+        {
+            level.Buckets[level.Count % historyCapacity] = level.Pending;
+            level.Count++;
+            level.PendingCount = 0;
+        }
+        bucketSize *= historyLevelFactor;
+    }
+}
+
+int MinMaxHistory::GetLevelFor(uint64_t samplesPerBucket)
+{
+    int level = 0;
+    uint64_t bucketSize = 1;
+    while (level + 1 < historyLevels && bucketSize * historyLevelFactor <= samplesPerBucket)
+    {
+        bucketSize *= historyLevelFactor;
+        level++;
+    }
+    return level;
+}
+
+int MinMaxHistory::GetLevelKeeping(uint64_t sample) const
+{
+    uint64_t bucketSize = 1;
+    for (int level = 0; level < historyLevels; level++)
+    {
+        uint64_t oldestKept = levels[level].Count > (uint64_t)historyCapacity ? levels[level].Count - historyCapacity : 0;
+        if (sample / bucketSize >= oldestKept)
+            return level;
+        bucketSize *= historyLevelFactor;
+    }
+    return historyLevels - 1;
+}
+
+bool MinMaxHistory::GetRange(uint64_t begin, uint64_t end, int levelIndex, float& min, float& max) const
+{
+    const Level& level = levels[levelIndex];
+    if (end <= begin || level.Buckets.empty())
+        return false;
+
+    uint64_t bucketSize = 1;
+    for (int i = 0; i < levelIndex; i++)
+        bucketSize *= historyLevelFactor;
+
+    uint64_t oldestKept = level.Count > (uint64_t)historyCapacity ? level.Count - historyCapacity : 0;
+    uint64_t first = std::max(begin / bucketSize, oldestKept);
+    uint64_t last = (end - 1) / bucketSize;
+    bool found = false;
+    for (uint64_t bucket = first; bucket <= last; bucket++)
+    {
+        Bucket value;
+        if (bucket < level.Count)
+            value = level.Buckets[bucket % historyCapacity];
+        else if (bucket == level.Count && level.PendingCount > 0)
+            value = level.Pending;
+        else
+            break;
+
+        min = found ? std::min(min, value.Min) : value.Min;
+        max = found ? std::max(max, value.Max) : value.Max;
+        found = true;
+    }
+    return found;
+}
+
+void LevelHistory::Record(uint64_t step, const std::vector<float>& levels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    bool startOver = seriesHistory.size() != levels.size() || step < lastStep;
+    if (startOver)
+    {
+        seriesHistory.assign(levels.size(), MinMaxHistory());
+        for (MinMaxHistory& series : seriesHistory)
+            series.Clear();
+    }
+    else if (step == lastStep && !seriesHistory.empty() && seriesHistory[0].GetCount() > 0)
+    {
+        return;
+    }
+
+    uint64_t steps = startOver || seriesHistory.empty() || seriesHistory[0].GetCount() == 0 ? 1 : std::min(step - lastStep, maxFilledSteps);
+    for (size_t s = 0; s < levels.size(); s++)
+    {
+        for (uint64_t i = 0; i < steps; i++)
+            seriesHistory[s].Add(levels[s]);
+    }
+    lastStep = step;
+}
+
+size_t LevelHistory::GetSeriesCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return seriesHistory.size();
+}
+
+void LevelHistory::GetColumns(size_t series, uint64_t span, int columns, std::vector<float>& mins, std::vector<float>& maxs) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    mins.assign(columns, std::numeric_limits<float>::quiet_NaN());
+    maxs.assign(columns, std::numeric_limits<float>::quiet_NaN());
+    if (series >= seriesHistory.size() || columns <= 0)
+        return;
+
+    // The finest resolution that still has the start of the window, but no finer than a few buckets per column
+    const MinMaxHistory& history = seriesHistory[series];
+    int64_t count = (int64_t)history.GetCount();
+    span = std::max(span, (uint64_t)columns);
+    int64_t begin = count - (int64_t)span;
+    int level = std::max(MinMaxHistory::GetLevelFor(span / columns), history.GetLevelKeeping((uint64_t)std::max(begin, (int64_t)0)));
+
+    for (int column = 0; column < columns; column++)
+    {
+        int64_t columnBegin = std::max(begin + (int64_t)(column * span / columns), (int64_t)0);
+        int64_t columnEnd = begin + (int64_t)((column + 1) * span / columns);
+        if (columnEnd > columnBegin)
+            history.GetRange((uint64_t)columnBegin, (uint64_t)columnEnd, level, mins[column], maxs[column]);
+    }
+}
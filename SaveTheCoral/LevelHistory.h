@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Buckets kept per resolution, samples per bucket from one resolution to the next, and the number of resolutions.
+// The coarsest keeps 2048 * 4^10 samples, over a year at 60 steps per second. A bucket is 8 bytes, so a series takes
+// a fixed 11 * 2048 * 8 bytes, about 180 KB, whatever the uptime.
+const int historyCapacity = 2048;
+const int historyLevelFactor = 4;
+const int historyLevels = 11;
+
+// Minimum and maximum of a series at several resolutions. Resolution k has buckets of historyLevelFactor^k samples,
+// each a ring buffer of the newest historyCapacity buckets, and the bucket still being filled is kept apart so the
+// newest samples are there at every resolution. Any stretch of the series can be summed up from a handful of buckets
+// at the right resolution, so drawing costs the same whether the history is a minute or a week long.
+struct MinMaxHistory
+{
+    void Clear();
+    void Add(float value);
+
+    // Samples added so far
+    uint64_t GetCount() const
+    {
+        return count;
+    }
+
+    // Coarsest resolution with buckets of at most this many samples
+    static int GetLevelFor(uint64_t samplesPerBucket);
+
+    // Resolution from which the given sample is still kept
+    int GetLevelKeeping(uint64_t sample) const;
+
+    // Minimum and maximum over the samples [begin, end) at a resolution, from the buckets they touch; false if none
+    // of them is kept
+    bool GetRange(uint64_t begin, uint64_t end, int level, float& min, float& max) const;
+
+private:
+    struct Bucket
+    {
+        float Min;
+        float Max;
+    };
+
+    struct Level
+    {
+        std::vector<Bucket> Buckets;
+        uint64_t Count = 0;
+        Bucket Pending = { 0, 0 };
+        uint64_t PendingCount = 0;
+    };
+
+    Level levels[historyLevels];
+    uint64_t count = 0;
+};
+
+// The history of every species' level, one sample per simulation step. The simulation thread records every step
+// while the renderer reads the columns, so both lock.
+struct LevelHistory
+{
+    // Add the levels of a step; starts over when the number of species changes or the step goes back. Steps skipped
+    // since the last record (a follower only sees the steps it renders) get the new levels too.
+    void Record(uint64_t step, const std::vector<float>& levels);
+
+    size_t GetSeriesCount() const;
+
+    // Minimum and maximum of one series per column over the last span steps, oldest column first, for the given
+    // number of columns; columns without history are NaN
+    void GetColumns(size_t series, uint64_t span, int columns, std::vector<float>& mins, std::vector<float>& maxs) const;
+
+private:
+    std::vector<MinMaxHistory> seriesHistory;
+    uint64_t lastStep = 0;
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,46 @@
+#include "Profiler.h"
+#include <cstdio>
+
+void Profiler::Set(const std::string& name, double value)
+{
+    for (auto& entry : values)
+    {
+        if (entry.first == name)
+        {
+            entry.second = value;
+            return;
+        }
+    }
+    values.emplace_back(name, value);
+}
+
+const std::vector<std::pair<std::string, double>>& Profiler::GetValues() const
+{
+    return values;
+}
+
+void Profiler::Draw(sf::RenderTarget& target, const sf::Font& font, sf::Vector2f position) const
+{
+    if (!Visible)
+        return;
+
+    std::string lines;
+    char line[256];
+    for (const auto& entry : values)
+    {
+        std::snprintf(line, sizeof(line), "%s: %.2f\n", entry.first.c_str(), entry.second);
+        lines += line;
+    }
+
+    sf::Text text(lines, font, 18);
+    text.setPosition(position.x + 10, position.y + 10);
+    text.setFillColor(sf::Color::White);
+
+    sf::FloatRect bounds = text.getGlobalBounds();
+    sf::RectangleShape background(sf::Vector2f(bounds.width + 20, bounds.height + 20));
+    background.setPosition(position);
+    background.setFillColor(sf::Color(0, 0, 0, 160));
+
+    target.draw(background);
+    target.draw(text);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Named debugging values, shown as an overlay on top of the scene when visible
+struct Profiler
+{
+    bool Visible = false;
+
+    // Values are listed in the order they were first set
+    void Set(const std::string& name, double value);
+
+    const std::vector<std::pair<std::string, double>>& GetValues() const;
+
+    void Draw(sf::RenderTarget& target, const sf::Font& font, sf::Vector2f position) const;
+
+private:
+    std::vector<std::pair<std::string, double>> values;
+};
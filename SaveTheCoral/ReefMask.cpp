@@ -0,0 +1,191 @@
+#include "ReefMask.h"
+#include "Varint.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+const char reefMaskMagic[4] = { 'S', 'T', 'R', 'M' };
+
+// Part of the cache key, so a change to the classification does not pick up masks made by the old one
+const uint8_t reefMaskVersion = 1;
+
+// Rows per job chunk
+const int maskChunkRows = 16;
+
+uint64_t HashImagePixels(const uint8_t* pixels, unsigned int width, unsigned int height)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](uint8_t byte) { hash = (hash ^ byte) * 1099511628211ull; };
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        add((uint8_t)(width >> shift));
+        add((uint8_t)(height >> shift));
+    }
+    for (size_t i = 0; i < (size_t)width * height * 4; i++)
+        add(pixels[i]);
+    return hash;
+}
+
+// Water is blue to cyan and fairly saturated; the distant reef is hazy blue too and counts as water, which keeps it
+// from bleaching through the haze
+static bool IsWater(const uint8_t* pixel)
+{
+    int red = pixel[0];
+    int green = pixel[1];
+    int blue = pixel[2];
+    int maximum = std::max({ red, green, blue });
+    int minimum = std::min({ red, green, blue });
+    int chroma = maximum - minimum;
+    if (maximum == 0 || chroma * 100 < maximum * 30)
+        return false;
+
+    float hue;
+    if (maximum == red)
+        hue = 60.0f * (green - blue) / chroma;
+    else if (maximum == green)
+        hue = 60.0f * (blue - red) / chroma + 120.0f;
+    else
+        hue = 60.0f * (red - green) / chroma + 240.0f;
+    if (hue < 0)
+        hue += 360.0f;
+
+    return hue >= 165.0f && hue <= 215.0f;
+}
+
+// One pass of a square erosion (minimum) or dilation (maximum), split into a horizontal and a vertical pass
+static void Morph(JobSystem& jobs, std::vector<uint8_t>& mask, std::vector<uint8_t>& scratch, int width, int height, int radius, bool dilate)
+{
+    auto pick = [dilate](uint8_t a, uint8_t b) { return dilate ? std::max(a, b) : std::min(a, b); };
+
+    scratch.resize(mask.size());
+    jobs.ParallelFor(height, maskChunkRows, [&](int begin, int end)
+    {
+        for (int y = begin; y < end; y++)
+        {
+            const uint8_t* row = mask.data() + (size_t)y * width;
+            uint8_t* out = scratch.data() + (size_t)y * width;
+            for (int x = 0; x < width; x++)
+            {
+                uint8_t value = row[x];
+                for (int dx = std::max(x - radius, 0); dx <= std::min(x + radius, width - 1); dx++)
+                    value = pick(value, row[dx]);
+                out[x] = value;
+            }
+        }
+    });
+    jobs.ParallelFor(height, maskChunkRows, [&](int begin, int end)
+    {
+        for (int y = begin; y < end; y++)
+        {
+            uint8_t* out = mask.data() + (size_t)y * width;
+            std::copy(scratch.data() + (size_t)y * width, scratch.data() + (size_t)(y + 1) * width, out);
+            for (int dy = std::max(y - radius, 0); dy <= std::min(y + radius, height - 1); dy++)
+            {
+                const uint8_t* row = scratch.data() + (size_t)dy * width;
+                for (int x = 0; x < width; x++)
+                    out[x] = pick(out[x], row[x]);
+            }
+        }
+    });
+}
+
+void ComputeReefMask(JobSystem& jobs, const uint8_t* pixels, unsigned int width, unsigned int height, std::vector<uint8_t>& mask)
+{
+    mask.resize((size_t)width * height);
+    jobs.ParallelFor((int)height, maskChunkRows, [&](int begin, int end)
+    {
+        for (size_t i = (size_t)begin * width; i < (size_t)end * width; i++)
+            mask[i] = IsWater(pixels + i * 4) ? 0 : 255;
+    });
+
+    // The radius grows with the image, so the result looks the same at every resolution tier
+    int radius = std::max((int)width / 640, 1);
+    std::vector<uint8_t> scratch;
+
+    // Opening removes coral specks in the water, closing fills water specks in the coral
+    Morph(jobs, mask, scratch, width, height, radius, false);
+    Morph(jobs, mask, scratch, width, height, radius, true);
+    Morph(jobs, mask, scratch, width, height, radius * 2, true);
+    Morph(jobs, mask, scratch, width, height, radius * 2, false);
+}
+
+static std::string GetCacheFileName(const std::string& cacheDirectory, uint64_t hash)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "reef_mask_%016llx_v%d.bin", (unsigned long long)hash, reefMaskVersion);
+    return (std::filesystem::path(cacheDirectory) / name).string();
+}
+
+// The mask is stored as alternating runs of water and coral, starting with water
+static bool ReadCachedMask(const std::string& fileName, unsigned int width, unsigned int height, std::vector<uint8_t>& mask)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const uint8_t* data = bytes.data();
+    const uint8_t* end = data + bytes.size();
+
+    uint64_t cachedWidth, cachedHeight;
+    if (bytes.size() < sizeof(reefMaskMagic) + 1 || !std::equal(reefMaskMagic, reefMaskMagic + sizeof(reefMaskMagic), data) ||
+        data[sizeof(reefMaskMagic)] != reefMaskVersion)
+    {
+        return false;
+    }
+    data += sizeof(reefMaskMagic) + 1;
+    if (!ReadVarint(data, end, cachedWidth) || !ReadVarint(data, end, cachedHeight) || cachedWidth != width || cachedHeight != height)
+        return false;
+
+    size_t count = (size_t)width * height;
+    mask.assign(count, 0);
+    uint8_t value = 0;
+    for (size_t i = 0; i < count; value = 255 - value)
+    {
+        uint64_t run;
+        if (!ReadVarint(data, end, run) || run > count - i)
+            return false;
+        std::fill(mask.begin() + i, mask.begin() + i + (size_t)run, value);
+        i += (size_t)run;
+    }
+    return true;
+}
+
+static bool WriteCachedMask(const std::string& fileName, unsigned int width, unsigned int height, const std::vector<uint8_t>& mask)
+{
+    std::vector<uint8_t> bytes(reefMaskMagic, reefMaskMagic + sizeof(reefMaskMagic));
+    bytes.push_back(reefMaskVersion);
+    WriteVarint(bytes, width);
+    WriteVarint(bytes, height);
+
+    uint8_t value = 0;
+    size_t runStart = 0;
+    for (size_t i = 0; i <= mask.size(); i++)
+    {
+        if (i == mask.size() || mask[i] != value)
+        {
+            WriteVarint(bytes, i - runStart);
+            runStart = i;
+            value = 255 - value;
+        }
+    }
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file.write((const char*)bytes.data(), bytes.size());
+    return file.good();
+}
+
+bool GetReefMask(JobSystem& jobs, const uint8_t* pixels, unsigned int width, unsigned int height, const std::string& cacheDirectory, std::vector<uint8_t>& mask)
+{
+    std::string fileName = GetCacheFileName(cacheDirectory, HashImagePixels(pixels, width, height));
+    if (ReadCachedMask(fileName, width, height, mask))
+        return true;
+
+    ComputeReefMask(jobs, pixels, width, height, mask);
+
+    // Without a cache the mask is simply computed again next time
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    WriteCachedMask(fileName, width, height, mask);
+    return false;
+}
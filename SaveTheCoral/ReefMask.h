@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+
+// Which pixels of the reef image show coral and which open water, 255 for coral and 0 for water. Computed once for
+// an image and then cached on disk under a hash of its pixels, so only the first start with a new image pays for it.
+
+// FNV-1a hash of the size and RGBA pixels of an image
+uint64_t HashImagePixels(const uint8_t* pixels, unsigned int width, unsigned int height);
+
+// Classify the pixels by colour (water is blue or cyan, everything else is coral), then clean up the speckles and
+// holes the classification leaves with a morphological opening and closing. Rows are split over the job system.
+void ComputeReefMask(JobSystem& jobs, const uint8_t* pixels, unsigned int width, unsigned int height, std::vector<uint8_t>& mask);
+
+// The mask from the cache if there is one for these pixels, otherwise compute it and write it to the cache.
+// Returns true if it came from the cache.
+bool GetReefMask(JobSystem& jobs, const uint8_t* pixels, unsigned int width, unsigned int height, const std::string& cacheDirectory, std::vector<uint8_t>& mask);
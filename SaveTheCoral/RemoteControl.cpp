@@ -0,0 +1,123 @@
+#include "RemoteControl.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// Datagrams handled per frame at most, so a flood of commands cannot stall the render loop
+const int maxDatagramsPerPoll = 64;
+
+bool RemoteControl::Start(unsigned short port)
+{
+    if (socket.bind(port) != sf::Socket::Done)
+        return false;
+
+    socket.setBlocking(false);
+    running = true;
+    std::cout << "Remote control listening on UDP port " << port << std::endl;
+    return true;
+}
+
+void RemoteControl::Poll(std::vector<SimulationCommand>& simulationCommands, std::vector<float>& benchmarkRequests)
+{
+    if (!running)
+        return;
+
+    sf::Packet packet;
+    sf::IpAddress sender;
+    unsigned short senderPort = 0;
+    for (int datagram = 0; datagram < maxDatagramsPerPoll && socket.receive(packet, sender, senderPort) == sf::Socket::Done; datagram++)
+    {
+        sf::Uint32 magic = 0;
+        sf::Uint8 version = 0;
+        sf::Uint8 count = 0;
+        if (!(packet >> magic >> version >> count) || magic != remoteControlMagic || version != remoteControlVersion)
+            continue;
+
+        for (int i = 0; i < count; i++)
+        {
+            RemoteCommand command;
+            if (!(packet >> command.Type >> command.Value))
+                break;
+
+            // Anyone can send to the port, and a NaN or infinity would get through the clamps into the simulation
+            if (!std::isfinite(command.Value))
+                continue;
+
+            SimulationCommand simulationCommand;
+            simulationCommand.Value = command.Value;
+            switch (command.Type)
+            {
+            case RemoteAdjustCarbonDioxide:
+                simulationCommand.Type = SimulationCommand::AdjustCarbonDioxide;
+                break;
+            case RemoteSetCarbonDioxide:
+                simulationCommand.Type = SimulationCommand::SetCarbonDioxide;
+                break;
+            case RemoteJumpToScenario:
+                simulationCommand.Type = SimulationCommand::JumpToScenario;
+                break;
+            case RemoteSetMoleculeScale:
+                simulationCommand.Type = SimulationCommand::SetMoleculeScale;
+                break;
+            case RemoteRunBenchmark:
+                benchmarkRequests.push_back(command.Value);
+                continue;
+            default:
+                continue;
+            }
+
+            // Coalesce with the previous command of the same kind
+            if (!simulationCommands.empty() && simulationCommands.back().Type == simulationCommand.Type)
+            {
+                if (simulationCommand.Type == SimulationCommand::AdjustCarbonDioxide)
+                    simulationCommands.back().Value += simulationCommand.Value;
+                else
+                    simulationCommands.back().Value = simulationCommand.Value;
+                continue;
+            }
+            simulationCommands.push_back(simulationCommand);
+        }
+    }
+}
+
+bool ParseRemoteCommands(const std::vector<std::string>& words, std::vector<RemoteCommand>& commands)
+{
+    for (size_t i = 0; i + 1 < words.size(); i += 2)
+    {
+        RemoteCommand command;
+        char* end = nullptr;
+        command.Value = std::strtof(words[i + 1].c_str(), &end);
+        if (end == words[i + 1].c_str() || *end != '\0' || !std::isfinite(command.Value))
+            return false;
+
+        if (words[i] == "adjust-co2")
+            command.Type = RemoteAdjustCarbonDioxide;
+        else if (words[i] == "set-co2")
+            command.Type = RemoteSetCarbonDioxide;
+        else if (words[i] == "scenario")
+            command.Type = RemoteJumpToScenario;
+        else if (words[i] == "molecule-scale")
+            command.Type = RemoteSetMoleculeScale;
+        else if (words[i] == "benchmark")
+            command.Type = RemoteRunBenchmark;
+        else
+            return false;
+
+        commands.push_back(command);
+    }
+    return words.size() % 2 == 0;
+}
+
+bool SendRemoteCommands(const std::string& host, unsigned short port, const std::vector<RemoteCommand>& commands)
+{
+    if (commands.size() > 255)
+        return false;
+
+    sf::Packet packet;
+    packet << remoteControlMagic << remoteControlVersion << (sf::Uint8)commands.size();
+    for (const RemoteCommand& command : commands)
+        packet << command.Type << command.Value;
+
+    sf::UdpSocket socket;
+    return socket.send(packet, host, port) == sf::Socket::Done;
+}
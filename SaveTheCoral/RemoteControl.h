@@ -0,0 +1,47 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <string>
+#include <vector>
+#include "SimulationThread.h"
+
+// Identifies remote control datagrams
+const sf::Uint32 remoteControlMagic = 0x53545243; // "STRC"
+const sf::Uint8 remoteControlVersion = 1;
+
+// A datagram holds a command count followed by that many (type, value) pairs
+enum RemoteCommandType
+{
+    RemoteAdjustCarbonDioxide = 0,
+    RemoteSetCarbonDioxide = 1,
+    RemoteJumpToScenario = 2,
+    RemoteSetMoleculeScale = 3,
+    // Record frame times for the given number of seconds
+    RemoteRunBenchmark = 4
+};
+
+struct RemoteCommand
+{
+    sf::Uint8 Type = RemoteAdjustCarbonDioxide;
+    float Value = 0;
+};
+
+// Receives remote control commands over UDP without ever blocking
+struct RemoteControl
+{
+    bool Start(unsigned short port);
+
+    // Drain the datagrams that arrived since the last call. Simulation commands are coalesced (adjustments summed,
+    // repeated settings reduced to the last one) and returned as one batch; benchmark requests are returned separately.
+    void Poll(std::vector<SimulationCommand>& simulationCommands, std::vector<float>& benchmarkRequests);
+
+private:
+    sf::UdpSocket socket;
+    bool running = false;
+};
+
+// Parse command line words ("set-co2 150 scenario 2 ...") into commands; returns false on an unknown command or a
+// value that is not a finite number
+bool ParseRemoteCommands(const std::vector<std::string>& words, std::vector<RemoteCommand>& commands);
+
+// Send commands to a running instance in one datagram
+bool SendRemoteCommands(const std::string& host, unsigned short port, const std::vector<RemoteCommand>& commands);
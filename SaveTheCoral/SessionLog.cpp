@@ -0,0 +1,208 @@
+#include "SessionLog.h"
+#include "Simulation.h"
+#include "Varint.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+const char sessionLogMagic[4] = { 'S', 'T', 'S', 'L' };
+const uint8_t sessionLogVersion = 2;
+const uint8_t stepRecord = 0;
+const uint8_t endRecord = 1;
+
+// Steps without commands still get a record this often, so the log shows how the session was paced
+const uint64_t timingInterval = 600;
+
+bool SessionRecorder::Start(const std::string& fileName, uint32_t seed, float stepRate, uint32_t configHash)
+{
+    file.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    bytes.assign(sessionLogMagic, sessionLogMagic + sizeof(sessionLogMagic));
+    bytes.push_back(sessionLogVersion);
+    WriteVarint(bytes, seed);
+    WriteFloat(bytes, stepRate);
+    WriteVarint(bytes, configHash);
+    file.write((const char*)bytes.data(), bytes.size());
+
+    clock.restart();
+    lastStep = 0;
+    lastTime = 0;
+    recording = true;
+    return true;
+}
+
+void SessionRecorder::WriteRecord(uint8_t type, uint64_t step)
+{
+    int64_t time = clock.getElapsedTime().asMicroseconds();
+    bytes.push_back(type);
+    WriteVarint(bytes, step - lastStep);
+    WriteVarint(bytes, (uint64_t)(time - lastTime));
+    lastStep = step;
+    lastTime = time;
+}
+
+void SessionRecorder::Record(uint64_t step, const std::vector<SimulationCommand>& commands)
+{
+    if (!recording || (commands.empty() && step - lastStep < timingInterval))
+        return;
+
+    bytes.clear();
+    WriteRecord(stepRecord, step);
+    WriteVarint(bytes, commands.size());
+    for (const SimulationCommand& command : commands)
+    {
+        bytes.push_back((uint8_t)command.Type);
+        WriteFloat(bytes, command.Value);
+    }
+    file.write((const char*)bytes.data(), bytes.size());
+}
+
+void SessionRecorder::Stop(uint64_t step)
+{
+    if (!recording)
+        return;
+
+    bytes.clear();
+    WriteRecord(endRecord, step);
+    WriteVarint(bytes, GetSimulationChecksum());
+    file.write((const char*)bytes.data(), bytes.size());
+    file.close();
+    recording = false;
+}
+
+bool SessionPlayer::Load(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const uint8_t* data = bytes.data();
+    const uint8_t* end = data + bytes.size();
+
+    if (bytes.size() < sizeof(sessionLogMagic) + 1 || !std::equal(sessionLogMagic, sessionLogMagic + sizeof(sessionLogMagic), data))
+        return false;
+    data += sizeof(sessionLogMagic);
+    if (*data++ != sessionLogVersion)
+        return false;
+
+    uint64_t seed, configHash;
+    if (!ReadVarint(data, end, seed) || !ReadFloat(data, end, StepRate) || StepRate <= 0 || !ReadVarint(data, end, configHash))
+        return false;
+    Seed = (uint32_t)seed;
+    ConfigHash = (uint32_t)configHash;
+
+    entries.clear();
+    nextEntry = 0;
+    uint64_t step = 0;
+    uint64_t time = 0;
+    while (data < end)
+    {
+        uint8_t type = *data++;
+        uint64_t steps, microseconds;
+        if (!ReadVarint(data, end, steps) || !ReadVarint(data, end, microseconds))
+            return false;
+        step += steps;
+        time += microseconds;
+
+        if (type == endRecord)
+        {
+            uint64_t checksum;
+            if (!ReadVarint(data, end, checksum))
+                return false;
+            EndStep = step;
+            EndChecksum = (uint32_t)checksum;
+            RecordedDuration = time / 1e6f;
+            return true;
+        }
+
+        uint64_t commandCount;
+        if (type != stepRecord || !ReadVarint(data, end, commandCount) || commandCount > (uint64_t)(end - data))
+            return false;
+
+        Entry entry;
+        entry.Step = step;
+        for (uint64_t c = 0; c < commandCount; c++)
+        {
+            SimulationCommand command;
+            if (data >= end || *data > SimulationCommand::SetMoleculeScale)
+                return false;
+            command.Type = (SimulationCommand::CommandType)*data++;
+            if (!ReadFloat(data, end, command.Value))
+                return false;
+            entry.Commands.push_back(command);
+        }
+        if (!entry.Commands.empty())
+            entries.push_back(std::move(entry));
+    }
+
+    // A session that was not stopped cleanly has no end record
+    return false;
+}
+
+bool SessionPlayer::CheckConfig() const
+{
+    uint32_t hash = GetSpeciesConfigHash(speciesConfig);
+    if (hash == ConfigHash)
+        return true;
+
+    std::printf("The session was recorded with another species configuration (%08x, this one is %08x)\n", ConfigHash, hash);
+    return false;
+}
+
+void SessionPlayer::GetCommands(uint64_t step, std::vector<SimulationCommand>& commands)
+{
+    if (step == 0)
+        clock.restart();
+
+    for (; nextEntry < entries.size() && entries[nextEntry].Step <= step; nextEntry++)
+    {
+        if (entries[nextEntry].Step == step)
+            commands.insert(commands.end(), entries[nextEntry].Commands.begin(), entries[nextEntry].Commands.end());
+    }
+}
+
+bool SessionPlayer::IsFinished(uint64_t step) const
+{
+    return step >= EndStep;
+}
+
+bool SessionPlayer::Finish()
+{
+    if (finished)
+        return matched;
+
+    finished = true;
+    uint32_t checksum = GetSimulationChecksum();
+    matched = checksum == EndChecksum;
+    float time = clock.getElapsedTime().asSeconds();
+    std::printf("Replayed %llu steps in %.2f s (recorded in %.2f s, %.1fx): final state %s (%08x, recorded %08x)\n",
+        (unsigned long long)EndStep, time, RecordedDuration, RecordedDuration / std::max(time, 1e-6f),
+        matched ? "matches" : "DIFFERS", checksum, EndChecksum);
+    return matched;
+}
+
+bool RunSessionReplay(const std::string& fileName)
+{
+    SessionPlayer player;
+    if (!player.Load(fileName))
+    {
+        std::printf("Could not read the session log %s\n", fileName.c_str());
+        return false;
+    }
+    if (!player.CheckConfig())
+        return false;
+
+    JobSystem jobs(JobSystem::GetDefaultWorkerCount());
+    InitializeSimulation(player.Seed);
+
+    std::vector<SimulationCommand> commands;
+    while (!player.IsFinished(simulationStep))
+    {
+        commands.clear();
+        player.GetCommands(simulationStep, commands);
+        for (const SimulationCommand& command : commands)
+            ApplySimulationCommand(command);
+        StepSimulation(jobs);
+    }
+    return player.Finish();
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <SFML/System/Clock.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "SimulationThread.h"
+
+// Sessions are logged as the seed and the commands applied before each step. The simulation is deterministic for
+// a given seed, so replaying the commands at the same steps reproduces the session exactly, whatever the timing.
+//
+// The species configuration is not in the log, only a hash of it, and a session only replays with the same one.
+//
+// Layout: "STSL", version byte, varint seed, float step rate, varint configuration hash, then records. A step record is a 0 byte, varint
+// steps since the previous record, varint microseconds since the previous record, varint command count and the
+// commands as a type byte and a float; the end record is a 1 byte, varint steps, varint microseconds and the
+// checksum of the final state as a varint.
+struct SessionRecorder
+{
+    bool Start(const std::string& fileName, uint32_t seed, float stepRate, uint32_t configHash);
+
+    // Called by the simulation thread before every step with the commands applied to that step
+    void Record(uint64_t step, const std::vector<SimulationCommand>& commands);
+
+    // Write the end record; call after the simulation has stopped
+    void Stop(uint64_t step);
+
+private:
+    void WriteRecord(uint8_t type, uint64_t step);
+
+    std::ofstream file;
+    std::vector<uint8_t> bytes;
+    sf::Clock clock;
+    uint64_t lastStep = 0;
+    int64_t lastTime = 0;
+    bool recording = false;
+};
+
+struct SessionPlayer
+{
+    uint32_t Seed = 0;
+    float StepRate = 60;
+    uint32_t ConfigHash = 0;
+    uint64_t EndStep = 0;
+    uint32_t EndChecksum = 0;
+    float RecordedDuration = 0;
+
+    bool Load(const std::string& fileName);
+
+    // Whether the session was recorded with the species configuration running now; prints why not
+    bool CheckConfig() const;
+
+    // Append the commands to apply before the given step; steps must be asked for in order
+    void GetCommands(uint64_t step, std::vector<SimulationCommand>& commands);
+
+    bool IsFinished(uint64_t step) const;
+
+    // Compare the final state with the recording and print the result, the first time it is called
+    bool Finish();
+
+private:
+    struct Entry
+    {
+        uint64_t Step;
+        std::vector<SimulationCommand> Commands;
+    };
+
+    std::vector<Entry> entries;
+    size_t nextEntry = 0;
+    sf::Clock clock;
+    bool finished = false;
+    bool matched = false;
+};
+
+// Replay a session as fast as possible without a window with the species configuration loaded; returns whether it
+// ended in the recorded state
+bool RunSessionReplay(const std::string& fileName);
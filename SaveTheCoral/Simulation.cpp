@@ -0,0 +1,433 @@
+#include "Simulation.h"
+#include "ChemistryGrid.h"
+#include "CoralGrowth.h"
+#include "CoralHealth.h"
+#include "Fauna.h"
+#include "FlowField.h"
+#include "TemperatureField.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+
+// Number of molecules updated per job chunk
+const int moleculeChunkSize = 4096;
+
+// Screen areas
+sf::Rect<float> reefRect(0.0f, menuHeight, windowWidth, windowHeight - menuHeight);
+
+std::deque<VariableData> speciesStorage;
+std::vector<VariableData*> allSpecies;
+SpeciesConfig speciesConfig;
+
+int calciumCarbonateSpecies = -1;
+int phLevelSpecies = -1;
+int waterTemperatureSpecies = -1;
+
+int FindSpecies(const std::string& id)
+{
+    for (size_t s = 0; s < allSpecies.size(); s++)
+    {
+        if (allSpecies[s]->Id == id)
+            return (int)s;
+    }
+    return -1;
+}
+
+static void FindCoralSpecies()
+{
+    calciumCarbonateSpecies = FindSpecies("calciumCarbonate");
+    phLevelSpecies = FindSpecies("phLevel");
+    waterTemperatureSpecies = FindSpecies("waterTemperature");
+}
+
+float GetRelativeLevel(int species, float fallback)
+{
+    if (species < 0)
+        return fallback;
+
+    const VariableData& data = *allSpecies[species];
+    return std::clamp((data.Level - data.Min) / data.GetRange(), 0.0f, 1.0f);
+}
+
+std::vector<std::string> GetSpeciesNames()
+{
+    std::vector<std::string> names;
+    for (const VariableData* data : allSpecies)
+        names.push_back(data->Name.toAnsiString());
+    return names;
+}
+
+void GetSpeciesLevels(std::vector<float>& levels)
+{
+    levels.resize(allSpecies.size());
+    for (size_t s = 0; s < allSpecies.size(); s++)
+        levels[s] = allSpecies[s]->Level;
+}
+
+uint32_t simulationSeed = 0;
+uint64_t simulationStep = 0;
+float moleculeScale = 1.0f;
+
+std::vector<Scenario> scenarios = {
+    { "Pre-industrial", 100 },
+    { "Today", 140 },
+    { "High emissions", 200 },
+};
+
+void VariableData::Initialize(const sf::String name, float min, float max, sf::Color color, float size, int speed, int moleculeCount)
+{
+    Name = name;
+    Min = min;
+    Max = max;
+    Color = color;
+    Size = size;
+    Speed = speed;
+    BaseMoleculeCount = moleculeCount;
+
+    for (int buffer = 0; buffer < 2; buffer++)
+    {
+        X[buffer].clear();
+        Y[buffer].clear();
+    }
+    Current = 0;
+    SetMoleculeCount((int)std::lround(moleculeCount * moleculeScale));
+}
+
+void VariableData::SetMoleculeCount(int moleculeCount)
+{
+    // Scatter new molecules over the reef, differently for each species
+    uint32_t nameHash = 2166136261u;
+    for (sf::Uint32 character : Name)
+        nameHash = (nameHash ^ character) * 16777619u;
+    Random random(simulationSeed ^ nameHash ^ Random::Hash((uint32_t)GetMoleculeCount()));
+
+    int oldCount = GetMoleculeCount();
+    for (int buffer = 0; buffer < 2; buffer++)
+    {
+        X[buffer].resize(moleculeCount);
+        Y[buffer].resize(moleculeCount);
+    }
+    for (int i = oldCount; i < moleculeCount; i++)
+    {
+        X[0][i] = X[1][i] = reefRect.left + random.NextInt((int)reefRect.width);
+        Y[0][i] = Y[1][i] = reefRect.top + random.NextInt((int)reefRect.height);
+    }
+}
+
+int VariableData::GetActiveCount() const
+{
+    return std::clamp((int)std::ceil(Level * moleculeScale), 0, GetMoleculeCount());
+}
+
+void VariableData::UpdateMolecules(int begin, int end, int activeCount, Random& random, const FlowField& flow, const ChemistryGrid& chemistry)
+{
+    const float* currentX = X[Current].data();
+    const float* currentY = Y[Current].data();
+    float* nextX = X[1 - Current].data();
+    float* nextY = Y[1 - Current].data();
+
+    float left = reefRect.left;
+    float top = reefRect.top;
+    float right = reefRect.left + reefRect.width;
+    float bottom = reefRect.top + reefRect.height;
+    bool resample = !CumulativeConcentration.empty();
+
+    int activeEnd = std::min(end, activeCount);
+    for (int i = begin; i < activeEnd; i++)
+    {
+        float u, v;
+        flow.Sample(currentX[i], currentY[i], u, v);
+
+        uint32_t bits = random.Next();
+        float x = currentX[i] + u + ((bits & 1) ? -1 : 1) * random.NextInt(Speed);
+        float y = currentY[i] + v + ((bits & 2) ? -1 : 1) * random.NextInt(Speed);
+        if (resample && (bits >> 8) % moleculeResampleInterval == 0)
+            chemistry.SamplePosition(*this, random, x, y);
+
+        if (x < left)
+            x += reefRect.width;
+        else if (x >= right)
+            x -= reefRect.width;
+        if (y < top)
+            y = top + top - y;
+        else if (y > bottom)
+            y = bottom + bottom - y;
+
+        // Only a jitter larger than the reef itself could still be outside
+        nextX[i] = std::max(std::min(x, right), left);
+        nextY[i] = std::max(std::min(y, bottom), top);
+    }
+
+    for (int i = std::max(begin, activeEnd); i < end; i++)
+    {
+        nextX[i] = currentX[i];
+        nextY[i] = currentY[i];
+    }
+}
+
+// Carbon dioxide in the air over the reef, relative to its range
+static float GetSurfaceCarbonDioxide()
+{
+    const VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    return (chemistryGrid.SurfaceLevel - control.Min) / control.GetRange();
+}
+
+// The water temperature species shows the temperature field, the chemistry leaves it alone
+static void StoreWaterTemperature()
+{
+    if (waterTemperatureSpecies < 0)
+        return;
+
+    VariableData& data = *allSpecies[waterTemperatureSpecies];
+    waterTemperatureField.Store(data, chemistryGrid.Current);
+    double sum = 0;
+    for (float value : data.Concentration[chemistryGrid.Current])
+        sum += value;
+    data.Level = data.Concentration[chemistryGrid.Current].empty() ? data.Min : (float)(sum / data.Concentration[chemistryGrid.Current].size());
+}
+
+void InitializeSimulation(uint32_t seed)
+{
+    simulationSeed = seed;
+    simulationStep = 0;
+    moleculeScale = 1.0f;
+
+    speciesStorage.clear();
+    allSpecies.clear();
+    for (const SpeciesConfig::SpeciesDefinition& definition : speciesConfig.Species)
+    {
+        speciesStorage.emplace_back();
+        VariableData& data = speciesStorage.back();
+        data.Id = definition.Id;
+        data.Initialize(sf::String::fromUtf8(definition.Name.begin(), definition.Name.end()), definition.Min, definition.Max,
+            definition.Color, definition.Size, definition.Speed, definition.MoleculeCount);
+        allSpecies.push_back(&data);
+    }
+    FindCoralSpecies();
+    coralReef.Initialize(seed);
+    coralHealth.Initialize(seed);
+    oceanFlow.Initialize(seed);
+    reefFauna.Initialize(seed);
+
+    // Start with the chemistry in balance everywhere
+    float level = allSpecies[speciesConfig.ControlSpecies]->Min;
+    BalanceChemistry(level);
+    chemistryGrid.Initialize(allSpecies);
+    SetCarbonDioxide(level);
+    waterTemperatureField.Initialize(seed, GetSurfaceCarbonDioxide());
+    StoreWaterTemperature();
+}
+
+void ApplySpeciesConfig(const SpeciesConfig& config)
+{
+    std::unordered_map<std::string, VariableData*> existing;
+    for (VariableData* data : allSpecies)
+        existing[data->Id] = data;
+
+    std::deque<VariableData> storage;
+    std::vector<VariableData*> species;
+    for (const SpeciesConfig::SpeciesDefinition& definition : config.Species)
+    {
+        sf::String name = sf::String::fromUtf8(definition.Name.begin(), definition.Name.end());
+        auto found = existing.find(definition.Id);
+        if (found != existing.end())
+        {
+            storage.push_back(std::move(*found->second));
+            VariableData& data = storage.back();
+            data.Name = name;
+            data.Min = definition.Min;
+            data.Max = definition.Max;
+            data.Color = definition.Color;
+            data.Size = definition.Size;
+            data.Speed = definition.Speed;
+            data.BaseMoleculeCount = definition.MoleculeCount;
+            data.SetMoleculeCount((int)std::lround(definition.MoleculeCount * moleculeScale));
+        }
+        else
+        {
+            storage.emplace_back();
+            VariableData& data = storage.back();
+            data.Id = definition.Id;
+            data.Initialize(name, definition.Min, definition.Max, definition.Color, definition.Size, definition.Speed, definition.MoleculeCount);
+            chemistryGrid.Fill(data, definition.Min);
+        }
+        species.push_back(&storage.back());
+    }
+
+    float surfaceLevel = existing.count(config.Species[config.ControlSpecies].Id) ? chemistryGrid.SurfaceLevel : config.Species[config.ControlSpecies].Min;
+    speciesStorage.swap(storage);
+    allSpecies.swap(species);
+    speciesConfig = config;
+    FindCoralSpecies();
+    SetCarbonDioxide(surfaceLevel);
+    StoreWaterTemperature();
+}
+
+void AdjustCarbonDioxide(float amount)
+{
+    SetCarbonDioxide(chemistryGrid.SurfaceLevel + amount);
+}
+
+void SetCarbonDioxide(float level)
+{
+    // This is what the user can change
+    const VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    chemistryGrid.SurfaceLevel = std::clamp(level, control.Min, control.Max);
+}
+
+void BalanceChemistry(float level)
+{
+    VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    control.Level = std::clamp(level, control.Min, control.Max);
+
+    float polutionFactor = (control.Level - control.Min) / control.GetRange();
+
+    // The balance of each reaction, see the configuration file for what each reaction stands for
+    for (const SpeciesConfig::Reaction& reaction : speciesConfig.Reactions)
+    {
+        VariableData& data = *allSpecies[reaction.Species];
+        if (reaction.Rises)
+            data.Level = data.Min + data.GetRange() * polutionFactor;
+        else
+            data.Level = data.Max - data.GetRange() * polutionFactor;
+    }
+}
+
+void JumpToScenario(int index)
+{
+    if (index >= 0 && index < (int)scenarios.size())
+        SetCarbonDioxide(scenarios[index].CarbonDioxideLevel);
+}
+
+void SetMoleculeScale(float scale)
+{
+    moleculeScale = std::clamp(scale, minMoleculeScale, maxMoleculeScale);
+    for (VariableData* data : allSpecies)
+        data->SetMoleculeCount((int)std::lround(data->BaseMoleculeCount * moleculeScale));
+}
+
+JobSystem::Handle DispatchMoleculeUpdate(JobSystem& jobs, const std::vector<VariableData*>& species, uint32_t seed, uint64_t step)
+{
+    // Flatten all species into one list of chunks, capturing the active counts as they are now
+    struct Chunk
+    {
+        VariableData* Data;
+        int Begin;
+        int End;
+        int ActiveCount;
+        uint32_t Seed;
+    };
+    auto chunks = std::make_shared<std::vector<Chunk>>();
+
+    uint32_t stepSeed = Random::Hash(seed ^ Random::Hash((uint32_t)step) ^ Random::Hash((uint32_t)(step >> 32) + 1));
+    for (size_t s = 0; s < species.size(); s++)
+    {
+        VariableData* data = species[s];
+        int activeCount = data->GetActiveCount();
+        for (int begin = 0; begin < data->GetMoleculeCount(); begin += moleculeChunkSize)
+        {
+            int end = std::min(begin + moleculeChunkSize, data->GetMoleculeCount());
+            uint32_t chunkSeed = Random::Hash(stepSeed ^ Random::Hash((uint32_t)(s * 0x9e3779b9u) ^ (uint32_t)begin));
+            chunks->push_back({ data, begin, end, activeCount, chunkSeed });
+        }
+    }
+
+    return jobs.Dispatch((int)chunks->size(), 1, [chunks](int begin, int end)
+    {
+        for (int c = begin; c < end; c++)
+        {
+            const Chunk& chunk = (*chunks)[c];
+            Random random(chunk.Seed);
+            chunk.Data->UpdateMolecules(chunk.Begin, chunk.End, chunk.ActiveCount, random, oceanFlow, chemistryGrid);
+        }
+    });
+}
+
+void SwapMoleculeBuffers(const std::vector<VariableData*>& species)
+{
+    for (VariableData* data : species)
+        data->Current = 1 - data->Current;
+}
+
+void StepSimulation(JobSystem& jobs)
+{
+    // The sun warms the water every few steps, in one long implicit step, before the chemistry carries it over
+    if (simulationStep % temperatureStepInterval == 0)
+    {
+        waterTemperatureField.Solve(jobs, GetSurfaceCarbonDioxide());
+        StoreWaterTemperature();
+    }
+
+    // The molecules move with the current of the last step while the next one is solved
+    JobSystem::Handle molecules = DispatchMoleculeUpdate(jobs, allSpecies, simulationSeed, simulationStep);
+    JobSystem::Handle flow = oceanFlow.Dispatch(jobs, simulationSeed, simulationStep);
+    JobSystem::Handle chemistry = chemistryGrid.Dispatch(jobs, allSpecies, oceanFlow, coralReef);
+
+    // Acid and warm water stress the coral and the animals alike
+    float stress = 0.5f * (1.0f - GetRelativeLevel(phLevelSpecies, 0.5f)) + 0.5f * GetRelativeLevel(waterTemperatureSpecies, 0.5f);
+    JobSystem::Handle fauna = reefFauna.Dispatch(jobs, simulationSeed, simulationStep, stress, oceanFlow);
+
+    // The coral grows alongside the molecules: with much calcium carbonate, pH high and the water cool it thrives
+    bool growCoral = simulationStep % coralStepInterval == 0;
+    JobSystem::Handle coral;
+    if (growCoral)
+    {
+        float growth = GetRelativeLevel(calciumCarbonateSpecies, 0.5f);
+        float acidity = 1.0f - GetRelativeLevel(phLevelSpecies, 0.5f);
+        float heat = GetRelativeLevel(waterTemperatureSpecies, 0.5f);
+        coral = coralReef.Dispatch(jobs, simulationSeed, simulationStep, growth, acidity, heat);
+    }
+
+    // How much the coral bleaches varies over the reef, and with the temperature of the water around it
+    coralHealth.Update(1.0f - GetRelativeLevel(phLevelSpecies, 0.5f), waterTemperatureField);
+
+    jobs.Wait(molecules);
+    jobs.Wait(flow);
+    jobs.Wait(chemistry);
+    jobs.Wait(fauna);
+    SwapMoleculeBuffers(allSpecies);
+    oceanFlow.Swap();
+    chemistryGrid.Swap(jobs, allSpecies);
+    reefFauna.Finish(simulationSeed, simulationStep, stress);
+    if (growCoral)
+    {
+        jobs.Wait(coral);
+        coralReef.Swap();
+    }
+    simulationStep++;
+}
+
+uint32_t GetSimulationChecksum()
+{
+    uint32_t hash = 2166136261u;
+    auto add = [&hash](float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * 16777619u;
+    };
+
+    for (const VariableData* data : allSpecies)
+    {
+        add(data->Level);
+        for (int i = 0; i < data->GetActiveCount(); i++)
+        {
+            add(data->X[data->Current][i]);
+            add(data->Y[data->Current][i]);
+        }
+    }
+    for (int i = 0; i < coralReef.Width * coralReef.Height; i++)
+        hash = (hash ^ coralReef.GetCells()[i]) * 16777619u;
+    for (int i = 0; i < coralHealth.Width * coralHealth.Height; i++)
+        hash = (hash ^ coralHealth.Quantized[i]) * 16777619u;
+    for (uint8_t value : waterTemperatureField.Quantized)
+        hash = (hash ^ value) * 16777619u;
+    for (int i = 0; i < reefFauna.GetCount(); i++)
+    {
+        add(reefFauna.X[reefFauna.Current][i]);
+        add(reefFauna.Y[reefFauna.Current][i]);
+    }
+    return hash;
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/String.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "JobSystem.h"
+#include "SpeciesConfig.h"
+
+#define MAX_SHAPES 1000
+
+// Define some constants (the layout is in these logical units, whatever the actual window size is)
+const float windowWidth = 2000;
+const float windowHeight = 1400;
+const float menuHeight = 220;
+
+struct ChemistryGrid;
+struct FlowField;
+
+// Screen areas
+extern sf::Rect<float> reefRect;
+
+// Small and fast random number generator. Parallel work gets one per chunk, seeded from the chunk's
+// position, so results are the same whatever the number of threads.
+struct Random
+{
+    uint32_t State;
+
+    explicit Random(uint32_t seed) : State(Hash(seed) | 1) {}
+
+    uint32_t Next()
+    {
+        State ^= State << 13;
+        State ^= State >> 17;
+        State ^= State << 5;
+        return State;
+    }
+
+    // Random integer in [0, range)
+    int NextInt(int range)
+    {
+        return range > 0 ? (int)(Next() % (uint32_t)range) : 0;
+    }
+
+    static uint32_t Hash(uint32_t value)
+    {
+        value ^= value >> 16;
+        value *= 0x7feb352d;
+        value ^= value >> 15;
+        value *= 0x846ca68b;
+        value ^= value >> 16;
+        return value;
+    }
+};
+
+// Define struct to keep track of various simulation data
+struct VariableData
+{
+    // Identifies the species in the configuration file
+    std::string Id;
+    sf::String Name;
+    float Min = 0;
+    float Max = 0;
+    float Level = 0;
+    float Size = 0;
+    int Speed = 0;
+    sf::Color Color = sf::Color::Black;
+
+    // Molecule positions, double buffered: an update reads the current buffer and writes the other one
+    std::vector<float> X[2];
+    std::vector<float> Y[2];
+    int Current = 0;
+
+    // Molecules at a molecule scale of 1
+    int BaseMoleculeCount = 0;
+
+    // Concentration per cell of the chemistry grid, double buffered like the positions, and its running sum over the
+    // cells for placing molecules where the concentration is
+    std::vector<float> Concentration[2];
+    std::vector<float> CumulativeConcentration;
+
+    void Initialize(const sf::String name, float min, float max, sf::Color color, float size, int speed, int moleculeCount = MAX_SHAPES);
+
+    // Grow or shrink the molecule buffers, new molecules are scattered over the reef
+    void SetMoleculeCount(int moleculeCount);
+
+    float GetRange() const
+    {
+        return Max - Min;
+    }
+
+    int GetMoleculeCount() const
+    {
+        return (int)X[0].size();
+    }
+
+    // Only molecules up to the current Level (times the molecule scale) are in the water
+    int GetActiveCount() const;
+
+    // Move the active molecules in [begin, end) with the current plus some random jitter, and carry the others over
+    // unchanged. Molecules leaving the reef on one side come back on the other, at the surface and seabed they bounce.
+    // Now and then a molecule is placed again where the species' concentration is, so the molecules show it.
+    void UpdateMolecules(int begin, int end, int activeCount, Random& random, const FlowField& flow, const ChemistryGrid& chemistry);
+};
+
+// Every species, in the order of the configuration
+extern std::vector<VariableData*> allSpecies;
+
+// The configuration the species were created from; its indices refer to allSpecies
+extern SpeciesConfig speciesConfig;
+
+// Position of the species with the given id in allSpecies, or -1; for use when the species change, not per step
+int FindSpecies(const std::string& id);
+
+// Species the coral reacts to, or -1 if the configuration has none of them
+extern int calciumCarbonateSpecies;
+extern int phLevelSpecies;
+extern int waterTemperatureSpecies;
+
+// Level of a species within its range from 0 to 1, or the fallback if there is no such species
+float GetRelativeLevel(int species, float fallback);
+
+// Switch to a new configuration. Species that are still there keep their molecules, new ones are scattered over
+// the reef. Only call this while nothing else is using the simulation.
+void ApplySpeciesConfig(const SpeciesConfig& config);
+
+// Names and current levels of all species, in the order of allSpecies
+std::vector<std::string> GetSpeciesNames();
+void GetSpeciesLevels(std::vector<float>& levels);
+
+extern uint32_t simulationSeed;
+extern uint64_t simulationStep;
+
+// Molecules per unit of Level, for load testing with many more molecules than the default
+extern float moleculeScale;
+const float minMoleculeScale = 0.1f;
+const float maxMoleculeScale = 1000.0f;
+
+// Preset carbon dioxide levels that can be jumped to
+struct Scenario
+{
+    const char* Name;
+    float CarbonDioxideLevel;
+};
+extern std::vector<Scenario> scenarios;
+
+// Start over with the species of speciesConfig
+void InitializeSimulation(uint32_t seed);
+
+// Change the level of the control species (carbon dioxide in the shipped configuration) at the surface. From there
+// it spreads through the water, and the rest of the chemistry follows it through the configured reactions.
+void AdjustCarbonDioxide(float amount);
+void SetCarbonDioxide(float level);
+
+// Set the levels of all species to their balance with the given carbon dioxide level, without touching the grids
+void BalanceChemistry(float level);
+
+void JumpToScenario(int index);
+
+void SetMoleculeScale(float scale);
+
+// Queue the molecule update of the given species for one step on the job system. Until the handle is
+// waited on, only the current position buffers may be read; afterwards call SwapMoleculeBuffers.
+JobSystem::Handle DispatchMoleculeUpdate(JobSystem& jobs, const std::vector<VariableData*>& species, uint32_t seed, uint64_t step);
+
+void SwapMoleculeBuffers(const std::vector<VariableData*>& species);
+
+// Advance the currents, the chemistry, all molecules, the animals and the coral health, and the coral every
+// coralStepInterval steps, by one simulation step
+void StepSimulation(JobSystem& jobs);
+
+// Hash of the levels, active molecule positions, coral, coral health and animal positions, to check that two runs
+// ended in the same state
+uint32_t GetSimulationChecksum();
@@ -0,0 +1,177 @@
+#include "SimulationThread.h"
+#include "LevelHistory.h"
+#include "SessionLog.h"
+#include "Simulation.h"
+#include "TimeSeries.h"
+#include <SFML/System/Sleep.hpp>
+#include <algorithm>
+
+// If the simulation falls further behind than this many steps, it skips ahead instead of trying to catch up
+const int maxCatchUpSteps = 4;
+
+void SimulationThread::Start(JobSystem& jobSystem, float stepRate)
+{
+    jobs = &jobSystem;
+    stepTime = 1.0f / stepRate;
+
+    // Publish the initial state so the renderer has something to show straight away
+    FillSnapshot(snapshots.GetWriteBuffer());
+    snapshots.Publish();
+
+    running = true;
+    thread = std::thread(&SimulationThread::Run, this);
+}
+
+void SimulationThread::Stop()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+SimulationThread::~SimulationThread()
+{
+    Stop();
+}
+
+void SimulationThread::Post(const SimulationCommand& command)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.push_back(command);
+}
+
+void SimulationThread::Post(const std::vector<SimulationCommand>& batch)
+{
+    std::lock_guard<std::mutex> lock(commandMutex);
+    commands.insert(commands.end(), batch.begin(), batch.end());
+}
+
+const SimulationSnapshot& SimulationThread::AcquireSnapshot()
+{
+    if (!snapshots.Acquire())
+        DuplicatedFrames++;
+
+    return snapshots.GetReadBuffer();
+}
+
+void SimulationThread::Run()
+{
+    sf::Clock clock;
+    sf::Clock rateClock;
+    float nextStepTime = 0;
+    int stepsCounted = 0;
+
+    while (running)
+    {
+        float now = clock.getElapsedTime().asSeconds();
+        if (now < nextStepTime)
+        {
+            sf::sleep(sf::seconds(nextStepTime - now));
+            continue;
+        }
+
+        Step();
+        nextStepTime = std::max(nextStepTime + stepTime, now - stepTime * maxCatchUpSteps);
+        stepsCounted++;
+
+        if (rateClock.getElapsedTime().asSeconds() >= 1.0f)
+        {
+            StepsPerSecond = stepsCounted / rateClock.restart().asSeconds();
+            stepsCounted = 0;
+        }
+    }
+}
+
+void SimulationThread::Step()
+{
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        pendingCommands.swap(commands);
+    }
+
+    // A replayed session ignores live input, and stops where the recording stopped
+    if (Player)
+    {
+        pendingCommands.clear();
+        if (Player->IsFinished(simulationStep))
+        {
+            Player->Finish();
+            return;
+        }
+        Player->GetCommands(simulationStep, pendingCommands);
+    }
+
+    if (Recorder)
+        Recorder->Record(simulationStep, pendingCommands);
+
+    for (const SimulationCommand& command : pendingCommands)
+        ApplySimulationCommand(command);
+    pendingCommands.clear();
+
+    // The ensemble runs on the workers while the simulation steps, it only needs what it captures first
+    JobSystem::Handle ensemble;
+    if (Ensemble)
+        ensemble = Ensemble->Dispatch(*jobs);
+
+    StepSimulation(*jobs);
+
+    if (Ensemble)
+    {
+        jobs->Wait(ensemble);
+        Ensemble->Finish();
+    }
+
+    if (LevelLog || History)
+        GetSpeciesLevels(levels);
+    if (LevelLog)
+        LevelLog->Add(simulationStep, levels);
+    if (History)
+        History->Record(simulationStep, levels);
+
+    FillSnapshot(snapshots.GetWriteBuffer());
+    if (!snapshots.Publish())
+        DroppedSteps++;
+}
+
+void ApplySimulationCommand(const SimulationCommand& command)
+{
+    switch (command.Type)
+    {
+    case SimulationCommand::AdjustCarbonDioxide:
+        AdjustCarbonDioxide(command.Value);
+        break;
+    case SimulationCommand::SetCarbonDioxide:
+        SetCarbonDioxide(command.Value);
+        break;
+    case SimulationCommand::JumpToScenario:
+        // The value may come from the network; out of range (or NaN) it cannot be cast to an index
+        JumpToScenario(command.Value >= 0 && command.Value < (float)scenarios.size() ? (int)command.Value : -1);
+        break;
+    case SimulationCommand::SetMoleculeScale:
+        SetMoleculeScale(command.Value);
+        break;
+    }
+}
+
+void SimulationThread::FillSnapshot(SimulationSnapshot& snapshot) const
+{
+    snapshot.Step = simulationStep;
+    snapshot.Species.resize(allSpecies.size());
+    for (size_t s = 0; s < allSpecies.size(); s++)
+    {
+        const VariableData& data = *allSpecies[s];
+        SimulationSnapshot::SpeciesState& species = snapshot.Species[s];
+        int activeCount = data.GetActiveCount();
+
+        species.Level = data.Level;
+        species.X.assign(data.X[data.Current].begin(), data.X[data.Current].begin() + activeCount);
+        species.Y.assign(data.Y[data.Current].begin(), data.Y[data.Current].begin() + activeCount);
+    }
+
+    snapshot.Coral.CopyFrom(coralReef);
+    snapshot.Health.CopyFrom(coralHealth);
+    snapshot.Fauna.CopyFrom(reefFauna);
+    snapshot.Temperature.CopyFrom(waterTemperatureField);
+    if (Ensemble)
+        snapshot.Ensemble = Ensemble->Bands;
+}
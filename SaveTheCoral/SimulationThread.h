@@ -0,0 +1,119 @@
+#pragma once
+#include <SFML/System/Clock.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CoralGrowth.h"
+#include "CoralHealth.h"
+#include "Ensemble.h"
+#include "Fauna.h"
+#include "TemperatureField.h"
+#include "JobSystem.h"
+#include "TripleBuffer.h"
+
+// Everything the renderer needs from one simulation step
+struct SimulationSnapshot
+{
+    struct SpeciesState
+    {
+        float Level = 0;
+
+        // Positions of the active molecules only
+        std::vector<float> X;
+        std::vector<float> Y;
+    };
+
+    uint64_t Step = 0;
+    std::vector<SpeciesState> Species;
+
+    // Only the tiles that changed are copied into each snapshot
+    CoralState Coral;
+
+    // Only copied when any cell's health changed
+    CoralHealthState Health;
+
+    FaunaState Fauna;
+
+    // Only copied when the temperature field was solved again
+    TemperatureState Temperature;
+
+    // Spread of every species over the ensemble, empty without one
+    std::vector<EnsembleBand> Ensemble;
+};
+
+// Changes to the simulation requested from other threads; they are applied at the start of the next step
+struct SimulationCommand
+{
+    enum CommandType
+    {
+        AdjustCarbonDioxide,
+        SetCarbonDioxide,
+        JumpToScenario,
+        SetMoleculeScale
+    };
+
+    CommandType Type = AdjustCarbonDioxide;
+    float Value = 0;
+};
+
+// Apply a command to the simulation right away; only call this from the thread that steps the simulation
+void ApplySimulationCommand(const SimulationCommand& command);
+
+struct SessionRecorder;
+struct SessionPlayer;
+struct TimeSeriesWriter;
+struct LevelHistory;
+
+// Runs the simulation at a fixed step rate on its own thread and hands every step over to the renderer through
+// a triple buffer, so neither side ever waits for the other
+struct SimulationThread
+{
+    // Steps published that the renderer never saw, and frames rendered again from an already seen step
+    std::atomic<uint64_t> DroppedSteps{ 0 };
+    uint64_t DuplicatedFrames = 0;
+    std::atomic<float> StepsPerSecond{ 0 };
+
+    // Optionally set before Start: log every step's commands, or take them from a log instead of Post
+    SessionRecorder* Recorder = nullptr;
+    SessionPlayer* Player = nullptr;
+
+    // Optionally set before Start: log the species levels after every step
+    TimeSeriesWriter* LevelLog = nullptr;
+
+    // Optionally set before Start: keep the species levels of every step for the history chart
+    LevelHistory* History = nullptr;
+
+    // Optionally set before Start: step an ensemble of the chemistry alongside every step
+    ChemistryEnsemble* Ensemble = nullptr;
+
+    void Start(JobSystem& jobs, float stepRate);
+    void Stop();
+
+    // Thread safe; queued until the start of the next step
+    void Post(const SimulationCommand& command);
+    void Post(const std::vector<SimulationCommand>& batch);
+
+    // Switch to the newest complete step, which stays valid until the next call; counts a duplicated frame if there is none
+    const SimulationSnapshot& AcquireSnapshot();
+
+    ~SimulationThread();
+
+private:
+    void Run();
+    void Step();
+    void FillSnapshot(SimulationSnapshot& snapshot) const;
+
+    JobSystem* jobs = nullptr;
+    float stepTime = 1.0f / 60.0f;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+
+    std::mutex commandMutex;
+    std::vector<SimulationCommand> commands;
+    std::vector<SimulationCommand> pendingCommands;
+    std::vector<float> levels;
+
+    TripleBuffer<SimulationSnapshot> snapshots;
+};
@@ -0,0 +1,478 @@
+#include "SnapshotCodec.h"
+#include "Simulation.h"
+#include "Varint.h"
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#ifdef SAVETHECORAL_LZ4
+#include <lz4.h>
+#endif
+
+const uint8_t keyframeFlag = 1;
+const uint8_t compressedFlag = 2;
+
+// Changed coral tiles sent per snapshot at most, so a reef that changes all at once goes out over several steps,
+// and unchanged tiles sent again per keyframe
+const int coralTilesPerSnapshot = 24;
+const int coralRefreshTiles = 16;
+
+const float pi = 3.14159265f;
+
+static uint16_t Quantize(float value, float origin, float size)
+{
+    return (uint16_t)std::clamp(std::lround((value - origin) / size * 65535.0f), 0L, 65535L);
+}
+
+static float Dequantize(uint16_t value, float origin, float size)
+{
+    return origin + value * size / 65535.0f;
+}
+
+static void WriteCoordinates(std::vector<uint8_t>& bytes, const std::vector<float>& values, std::vector<uint16_t>& previous,
+    size_t knownCount, float origin, float size)
+{
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        uint16_t value = Quantize(values[i], origin, size);
+        uint16_t base = i < knownCount ? previous[i] : 0;
+        WriteVarint(bytes, ZigZag((int32_t)value - (int32_t)base));
+        previous[i] = value;
+    }
+}
+
+static bool ReadCoordinates(const uint8_t*& data, const uint8_t* end, std::vector<float>& values, std::vector<uint16_t>& previous,
+    size_t knownCount, float origin, float size)
+{
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        uint64_t delta;
+        if (!ReadVarint(data, end, delta))
+            return false;
+
+        uint16_t base = i < knownCount ? previous[i] : 0;
+        uint16_t value = (uint16_t)(base + UnZigZag((uint32_t)delta));
+        values[i] = Dequantize(value, origin, size);
+        previous[i] = value;
+    }
+    return true;
+}
+
+void SnapshotEncoder::Encode(const SimulationSnapshot& snapshot, bool keyframe, std::vector<uint8_t>& bytes)
+{
+    keyframe = keyframe || !hasPrevious;
+
+    uint8_t flags = keyframe ? keyframeFlag : 0;
+    std::vector<uint8_t>& body = uncompressed;
+    body.clear();
+    WriteVarint(body, snapshot.Step);
+    if (!keyframe)
+        WriteVarint(body, previousStep);
+    WriteVarint(body, snapshot.Species.size());
+    for (const SimulationSnapshot::SpeciesState& species : snapshot.Species)
+    {
+        WriteFloat(body, species.Level);
+        WriteVarint(body, species.X.size());
+    }
+
+    previousX.resize(snapshot.Species.size());
+    previousY.resize(snapshot.Species.size());
+    for (size_t s = 0; s < snapshot.Species.size(); s++)
+    {
+        const SimulationSnapshot::SpeciesState& species = snapshot.Species[s];
+
+        // Molecules that were not in the previous snapshot are coded against zero
+        size_t knownCount = keyframe ? 0 : std::min(previousX[s].size(), species.X.size());
+        previousX[s].resize(species.X.size());
+        previousY[s].resize(species.Y.size());
+        WriteCoordinates(body, species.X, previousX[s], knownCount, reefRect.left, reefRect.width);
+        WriteCoordinates(body, species.Y, previousY[s], knownCount, reefRect.top, reefRect.height);
+    }
+    EncodeScene(snapshot, keyframe, body);
+
+    previousStep = snapshot.Step;
+    hasPrevious = true;
+
+    bytes.clear();
+#ifdef SAVETHECORAL_LZ4
+    if (Compress)
+    {
+        bytes.push_back(flags | compressedFlag);
+        WriteVarint(bytes, body.size());
+        size_t header = bytes.size();
+        bytes.resize(header + LZ4_compressBound((int)body.size()));
+        int compressedSize = LZ4_compress_default((const char*)body.data(), (char*)bytes.data() + header, (int)body.size(), (int)(bytes.size() - header));
+        bytes.resize(header + compressedSize);
+        return;
+    }
+#endif
+    bytes.push_back(flags);
+    bytes.insert(bytes.end(), body.begin(), body.end());
+}
+
+// Write a grid of bytes if it is sent with this snapshot
+template <typename State>
+static void WriteGrid(std::vector<uint8_t>& bytes, const State& state, bool send)
+{
+    send = send && state.Width > 0 && state.Values.size() >= (size_t)state.Width * state.Height;
+    bytes.push_back(send ? 1 : 0);
+    if (!send)
+        return;
+
+    WriteVarint(bytes, state.Width);
+    WriteVarint(bytes, state.Height);
+    WriteVarint(bytes, state.Version);
+    bytes.insert(bytes.end(), state.Values.begin(), state.Values.begin() + (size_t)state.Width * state.Height);
+}
+
+template <typename State>
+static bool ReadGrid(const uint8_t*& data, const uint8_t* end, State& state)
+{
+    if (data >= end)
+        return false;
+    if (*data++ == 0)
+        return true;
+
+    uint64_t width, height, version;
+    if (!ReadVarint(data, end, width) || !ReadVarint(data, end, height) || !ReadVarint(data, end, version) ||
+        width > 65535 || height > 65535 || width * height > (uint64_t)(end - data))
+        return false;
+
+    state.Width = (int)width;
+    state.Height = (int)height;
+    state.Version = version;
+    state.Values.assign(data, data + width * height);
+    data += width * height;
+    return true;
+}
+
+void SnapshotEncoder::EncodeScene(const SimulationSnapshot& snapshot, bool keyframe, std::vector<uint8_t>& body)
+{
+    // Coral: the tiles that changed, picking up where the last snapshot left off, plus a slice of the rest with a keyframe
+    const CoralState& coral = snapshot.Coral;
+    int tileCount = coral.TilesX * coral.TilesY;
+    if (coralSentVersions.size() != (size_t)tileCount)
+    {
+        coralSentVersions.assign(tileCount, UINT64_MAX);
+        coralCursor = 0;
+        coralRefreshCursor = 0;
+    }
+    if (keyframe)
+    {
+        for (int i = 0; i < coralRefreshTiles && i < tileCount; i++)
+        {
+            coralSentVersions[coralRefreshCursor] = UINT64_MAX;
+            coralRefreshCursor = (coralRefreshCursor + 1) % tileCount;
+        }
+    }
+
+    WriteVarint(body, coral.Width);
+    WriteVarint(body, coral.Height);
+    WriteVarint(body, coral.TilesX);
+    WriteVarint(body, coral.TilesY);
+    int tiles[coralTilesPerSnapshot];
+    int sentCount = 0;
+    for (int i = 0; i < tileCount && sentCount < coralTilesPerSnapshot; i++)
+    {
+        int tile = (coralCursor + i) % tileCount;
+        if (coralSentVersions[tile] != coral.TileVersions[tile])
+            tiles[sentCount++] = tile;
+    }
+    if (sentCount > 0)
+        coralCursor = (tiles[sentCount - 1] + 1) % tileCount;
+
+    WriteVarint(body, sentCount);
+    for (int i = 0; i < sentCount; i++)
+    {
+        int tile = tiles[i];
+        WriteVarint(body, tile);
+        WriteVarint(body, coral.TileVersions[tile]);
+        int left = (tile % coral.TilesX) * coralTileSize;
+        int top = (tile / coral.TilesX) * coralTileSize;
+        int width = std::min(coralTileSize, coral.Width - left);
+        int bottom = std::min(top + coralTileSize, coral.Height);
+        for (int y = top; y < bottom; y++)
+            body.insert(body.end(), coral.Cells.begin() + y * coral.Width + left, coral.Cells.begin() + y * coral.Width + left + width);
+        coralSentVersions[tile] = coral.TileVersions[tile];
+    }
+
+    // Health and temperature when they changed
+    WriteGrid(body, snapshot.Health, keyframe || snapshot.Health.Version != healthVersion);
+    healthVersion = snapshot.Health.Version;
+    WriteGrid(body, snapshot.Temperature, keyframe || snapshot.Temperature.Version != temperatureVersion);
+    temperatureVersion = snapshot.Temperature.Version;
+
+    // Animals
+    const FaunaState& fauna = snapshot.Fauna;
+    WriteVarint(body, fauna.X.size());
+    int32_t previousX = 0;
+    int32_t previousY = 0;
+    for (size_t i = 0; i < fauna.X.size(); i++)
+    {
+        uint8_t health = (uint8_t)std::lround(std::clamp(fauna.Health[i], 0.0f, 1.0f) * 127);
+        body.push_back((uint8_t)(fauna.Kind[i] << 7) | health);
+
+        int32_t x = Quantize(fauna.X[i], reefRect.left, reefRect.width);
+        int32_t y = Quantize(fauna.Y[i], reefRect.top, reefRect.height);
+        WriteVarint(body, ZigZag(x - previousX));
+        WriteVarint(body, ZigZag(y - previousY));
+        previousX = x;
+        previousY = y;
+
+        if (fauna.Kind[i] == FaunaFish)
+        {
+            float angle = std::atan2(fauna.VelocityY[i], fauna.VelocityX[i]);
+            body.push_back((uint8_t)std::lround((angle + pi) / (2 * pi) * 255));
+        }
+    }
+}
+
+void SnapshotEncoder::Reset()
+{
+    hasPrevious = false;
+    coralSentVersions.clear();
+}
+
+bool SnapshotDecoder::Decode(const uint8_t* data, size_t size, SimulationSnapshot& snapshot)
+{
+    if (size < 1)
+        return false;
+
+    const uint8_t* end = data + size;
+    uint8_t flags = *data++;
+    bool keyframe = (flags & keyframeFlag) != 0;
+
+    if (flags & compressedFlag)
+    {
+#ifdef SAVETHECORAL_LZ4
+        uint64_t bodySize;
+        if (!ReadVarint(data, end, bodySize) || bodySize > (uint64_t)LZ4_MAX_INPUT_SIZE)
+            return false;
+
+        uncompressed.resize((size_t)bodySize);
+        if (LZ4_decompress_safe((const char*)data, (char*)uncompressed.data(), (int)(end - data), (int)bodySize) != (int)bodySize)
+            return false;
+        data = uncompressed.data();
+        end = data + uncompressed.size();
+#else
+        return false;
+#endif
+    }
+
+    uint64_t step, baseStep = 0, speciesCount;
+    if (!ReadVarint(data, end, step))
+        return false;
+    if (!keyframe && (!ReadVarint(data, end, baseStep) || !hasPrevious || baseStep != previousStep))
+        return false;
+    if (!ReadVarint(data, end, speciesCount) || speciesCount > 255)
+        return false;
+
+    snapshot.Step = step;
+    snapshot.Species.resize((size_t)speciesCount);
+    for (SimulationSnapshot::SpeciesState& species : snapshot.Species)
+    {
+        uint64_t count;
+        if (!ReadFloat(data, end, species.Level) || !ReadVarint(data, end, count) || count > (uint64_t)(end - data))
+            return false;
+        species.X.resize((size_t)count);
+        species.Y.resize((size_t)count);
+    }
+
+    // A failed decode leaves nothing to delta against
+    hasPrevious = false;
+    previousX.resize(snapshot.Species.size());
+    previousY.resize(snapshot.Species.size());
+    for (size_t s = 0; s < snapshot.Species.size(); s++)
+    {
+        SimulationSnapshot::SpeciesState& species = snapshot.Species[s];
+        size_t knownCount = keyframe ? 0 : std::min(previousX[s].size(), species.X.size());
+        previousX[s].resize(species.X.size());
+        previousY[s].resize(species.Y.size());
+        if (!ReadCoordinates(data, end, species.X, previousX[s], knownCount, reefRect.left, reefRect.width) ||
+            !ReadCoordinates(data, end, species.Y, previousY[s], knownCount, reefRect.top, reefRect.height))
+            return false;
+    }
+    if (!DecodeScene(data, end, snapshot))
+        return false;
+
+    previousStep = step;
+    hasPrevious = true;
+    return true;
+}
+
+bool SnapshotDecoder::DecodeScene(const uint8_t*& data, const uint8_t* end, SimulationSnapshot& snapshot)
+{
+    // Coral tiles, into the grid kept from the earlier snapshots
+    uint64_t width, height, tilesX, tilesY, tileCount;
+    if (!ReadVarint(data, end, width) || !ReadVarint(data, end, height) || !ReadVarint(data, end, tilesX) ||
+        !ReadVarint(data, end, tilesY) || !ReadVarint(data, end, tileCount))
+        return false;
+    if (width > 65535 || height > 65535 || tilesX != (width + coralTileSize - 1) / coralTileSize || tilesY != (height + coralTileSize - 1) / coralTileSize)
+        return false;
+    if (coral.Width != (int)width || coral.Height != (int)height)
+    {
+        coral.Width = (int)width;
+        coral.Height = (int)height;
+        coral.TilesX = (int)tilesX;
+        coral.TilesY = (int)tilesY;
+        coral.Cells.assign(coral.Width * coral.Height, 0);
+        coral.TileVersions.assign(coral.TilesX * coral.TilesY, 0);
+    }
+
+    for (uint64_t i = 0; i < tileCount; i++)
+    {
+        uint64_t tile, version;
+        if (!ReadVarint(data, end, tile) || !ReadVarint(data, end, version) || tile >= coral.TileVersions.size())
+            return false;
+
+        int left = (int)(tile % tilesX) * coralTileSize;
+        int top = (int)(tile / tilesX) * coralTileSize;
+        int tileWidth = std::min(coralTileSize, coral.Width - left);
+        int bottom = std::min(top + coralTileSize, coral.Height);
+        if ((uint64_t)(end - data) < (uint64_t)tileWidth * (bottom - top))
+            return false;
+        for (int y = top; y < bottom; y++, data += tileWidth)
+            std::copy(data, data + tileWidth, coral.Cells.begin() + y * coral.Width + left);
+        coral.TileVersions[(size_t)tile] = version;
+    }
+
+    if (!ReadGrid(data, end, health) || !ReadGrid(data, end, temperature))
+        return false;
+
+    // Animals
+    uint64_t count;
+    if (!ReadVarint(data, end, count) || count > (uint64_t)(end - data))
+        return false;
+
+    FaunaState& fauna = snapshot.Fauna;
+    fauna.X.resize((size_t)count);
+    fauna.Y.resize((size_t)count);
+    fauna.VelocityX.resize((size_t)count);
+    fauna.VelocityY.resize((size_t)count);
+    fauna.Health.resize((size_t)count);
+    fauna.Kind.resize((size_t)count);
+    int32_t x = 0;
+    int32_t y = 0;
+    for (size_t i = 0; i < fauna.X.size(); i++)
+    {
+        uint64_t deltaX, deltaY;
+        if (data >= end)
+            return false;
+        uint8_t kindAndHealth = *data++;
+        if (!ReadVarint(data, end, deltaX) || !ReadVarint(data, end, deltaY))
+            return false;
+
+        x = (uint16_t)(x + UnZigZag((uint32_t)deltaX));
+        y = (uint16_t)(y + UnZigZag((uint32_t)deltaY));
+        fauna.X[i] = Dequantize((uint16_t)x, reefRect.left, reefRect.width);
+        fauna.Y[i] = Dequantize((uint16_t)y, reefRect.top, reefRect.height);
+        fauna.Kind[i] = kindAndHealth >> 7;
+        fauna.Health[i] = (kindAndHealth & 0x7f) / 127.0f;
+
+        // Only the direction of the fish is kept
+        fauna.VelocityX[i] = 0;
+        fauna.VelocityY[i] = 0;
+        if (fauna.Kind[i] == FaunaFish)
+        {
+            if (data >= end)
+                return false;
+            float angle = *data++ / 255.0f * 2 * pi - pi;
+            fauna.VelocityX[i] = std::cos(angle);
+            fauna.VelocityY[i] = std::sin(angle);
+        }
+    }
+
+    snapshot.Coral = coral;
+    snapshot.Health = health;
+    snapshot.Temperature = temperature;
+    return true;
+}
+
+void SnapshotDecoder::Reset()
+{
+    hasPrevious = false;
+}
+
+bool SnapshotDecoder::IsKeyframe(const uint8_t* data, size_t size)
+{
+    return size > 0 && (data[0] & keyframeFlag) != 0;
+}
+
+void RunSnapshotCodecBenchmark()
+{
+    const int moleculeCounts[] = { 10000, 100000, 1000000 };
+    const int frames = 60;
+    const float rate = 60;
+
+    // The worst case error is half a quantization step
+    float maxErrorX = reefRect.width / 65535.0f;
+    float maxErrorY = reefRect.height / 65535.0f;
+
+    std::printf("%10s %5s %12s %12s %10s %12s %12s %6s\n", "molecules", "lz4", "bytes/frame", "MB/s@60Hz", "vs floats", "encode MB/s", "decode MB/s", "ok");
+    for (int moleculeCount : moleculeCounts)
+    {
+        // Move real molecules between the frames, so the deltas look like the ones the simulation makes
+        VariableData data;
+        data.Initialize("Benchmark", 0, (float)moleculeCount, sf::Color::Red, 5, 3, moleculeCount);
+        data.Level = (float)moleculeCount;
+        std::vector<VariableData*> species = { &data };
+        JobSystem jobs(JobSystem::GetDefaultWorkerCount());
+
+        std::vector<SimulationSnapshot> snapshots(frames);
+        for (int frame = 0; frame < frames; frame++)
+        {
+            jobs.Wait(DispatchMoleculeUpdate(jobs, species, 1, frame));
+            SwapMoleculeBuffers(species);
+
+            SimulationSnapshot& snapshot = snapshots[frame];
+            snapshot.Step = frame + 1;
+            snapshot.Species.resize(1);
+            snapshot.Species[0].Level = data.Level;
+            snapshot.Species[0].X = data.X[data.Current];
+            snapshot.Species[0].Y = data.Y[data.Current];
+        }
+
+        double rawBytes = (double)moleculeCount * 2 * sizeof(float);
+#ifdef SAVETHECORAL_LZ4
+        const bool compressModes[] = { false, true };
+#else
+        const bool compressModes[] = { false };
+#endif
+        for (bool compress : compressModes)
+        {
+            SnapshotEncoder encoder;
+            SnapshotDecoder decoder;
+            encoder.Compress = compress;
+
+            std::vector<std::vector<uint8_t>> encoded(frames);
+            sf::Clock clock;
+            for (int frame = 0; frame < frames; frame++)
+                encoder.Encode(snapshots[frame], frame == 0, encoded[frame]);
+            float encodeTime = clock.restart().asSeconds();
+
+            // Decode one frame at a time, so the check does not disturb the timing much
+            bool ok = true;
+            SimulationSnapshot decoded;
+            float decodeTime = 0;
+            size_t totalBytes = 0;
+            for (int frame = 0; frame < frames; frame++)
+            {
+                totalBytes += encoded[frame].size();
+                clock.restart();
+                ok = decoder.Decode(encoded[frame].data(), encoded[frame].size(), decoded) && ok;
+                decodeTime += clock.getElapsedTime().asSeconds();
+
+                const SimulationSnapshot::SpeciesState& expected = snapshots[frame].Species[0];
+                ok = ok && decoded.Step == snapshots[frame].Step && decoded.Species.size() == 1 && decoded.Species[0].X.size() == expected.X.size();
+                for (size_t i = 0; ok && i < expected.X.size(); i++)
+                    ok = std::fabs(decoded.Species[0].X[i] - expected.X[i]) <= maxErrorX && std::fabs(decoded.Species[0].Y[i] - expected.Y[i]) <= maxErrorY;
+            }
+
+            // Leave the keyframe out of the steady state size
+            double deltaBytes = (double)(totalBytes - encoded[0].size()) / (frames - 1);
+            double megabytes = rawBytes * frames / 1e6;
+            std::printf("%10d %5s %12.0f %12.2f %9.1f%% %12.0f %12.0f %6s\n", moleculeCount, compress ? "yes" : "no", deltaBytes,
+                deltaBytes * rate / 1e6, deltaBytes * 100 / rawBytes, megabytes / encodeTime, megabytes / decodeTime, ok ? "yes" : "FAILED");
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SimulationThread.h"
+
+// Compact binary encoding of simulation snapshots for the network and for files. Molecule positions are quantized
+// to 16 bits within reefRect and delta coded against the previous snapshot as zigzag varints, all X deltas of a
+// species before its Y deltas; the result can be LZ4 compressed when built with SAVETHECORAL_LZ4.
+//
+// The rest of the scene follows the molecules. Coral tiles whose version changed since they were last sent go out
+// a few at a time, and every keyframe sends a slice of the others again, so a decoder that missed a step catches up
+// within a few keyframes. Health and temperature go out whole when their version changes and with every keyframe.
+// Animals are sent every step, their positions delta coded against the animal before them (they are sorted by
+// where they are), fish with the direction they swim in.
+//
+// Layout: flags byte, varint step, varint base step (deltas only), varint species count, then per species the
+// level as a little-endian float and a varint molecule count, then the coordinates. Then the coral: varint width,
+// height, tiles across and down and tile count, per tile a varint index and version and its cells row by row. Then
+// the health and the temperature: a byte that is 1 if they follow, and if so varint width, height and version and
+// a byte per cell. Then the animals: varint count, per animal a byte with the kind in the top bit and the health
+// in the other seven, the zigzag varint position deltas and for fish a byte of direction.
+struct SnapshotEncoder
+{
+    // Compress with LZ4 if it was compiled in
+    bool Compress = false;
+
+    // Replaces bytes with the encoding of the snapshot; a keyframe does not depend on any earlier snapshot
+    void Encode(const SimulationSnapshot& snapshot, bool keyframe, std::vector<uint8_t>& bytes);
+
+    // Forget the previous snapshot, so the next one is encoded as a keyframe
+    void Reset();
+
+private:
+    void EncodeScene(const SimulationSnapshot& snapshot, bool keyframe, std::vector<uint8_t>& body);
+
+    std::vector<std::vector<uint16_t>> previousX;
+    std::vector<std::vector<uint16_t>> previousY;
+    uint64_t previousStep = 0;
+    bool hasPrevious = false;
+    std::vector<uint8_t> uncompressed;
+
+    // Version of every coral tile as last sent, where the search for changed tiles goes on from, and the next
+    // tile to send again with a keyframe
+    std::vector<uint64_t> coralSentVersions;
+    int coralCursor = 0;
+    int coralRefreshCursor = 0;
+    uint64_t healthVersion = 0;
+    uint64_t temperatureVersion = 0;
+};
+
+struct SnapshotDecoder
+{
+    // Returns false for malformed data, or for a delta against a snapshot this decoder has not decoded last
+    bool Decode(const uint8_t* data, size_t size, SimulationSnapshot& snapshot);
+
+    // Whether encoded data starting here is a keyframe, from its first byte
+    static bool IsKeyframe(const uint8_t* data, size_t size);
+
+    void Reset();
+
+private:
+    bool DecodeScene(const uint8_t*& data, const uint8_t* end, SimulationSnapshot& snapshot);
+
+    std::vector<std::vector<uint16_t>> previousX;
+    std::vector<std::vector<uint16_t>> previousY;
+    uint64_t previousStep = 0;
+    bool hasPrevious = false;
+    std::vector<uint8_t> uncompressed;
+
+    // The scene as far as it has arrived; coral tiles and grids stay until they are sent again
+    CoralState coral;
+    CoralHealthState health;
+    TemperatureState temperature;
+};
+
+// Encode and decode snapshots of 10k, 100k and 1M moving molecules, check the round trip and print sizes and speeds
+void RunSnapshotCodecBenchmark();
@@ -0,0 +1,264 @@
+#include "SpeciesConfig.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+
+// Split a line into words; double quotes group words and \" is a quote inside them, # starts a comment
+static bool SplitLine(const std::string& line, std::vector<std::string>& words)
+{
+    words.clear();
+    size_t i = 0;
+    while (i < line.size())
+    {
+        char character = line[i];
+        if (character == '#')
+            break;
+        if (character == ' ' || character == '\t' || character == '\r')
+        {
+            i++;
+            continue;
+        }
+
+        std::string word;
+        if (character == '"')
+        {
+            for (i++; i < line.size() && line[i] != '"'; i++)
+            {
+                if (line[i] == '\\' && i + 1 < line.size())
+                    i++;
+                word += line[i];
+            }
+            if (i >= line.size())
+                return false;
+            i++;
+        }
+        else
+        {
+            for (; i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '#'; i++)
+                word += line[i];
+        }
+        words.push_back(word);
+    }
+    return true;
+}
+
+// A species id used before all species are known, and where its index goes
+struct SpeciesReference
+{
+    enum Target
+    {
+        Control,
+        Reaction,
+        Legend
+    };
+
+    std::string Id;
+    int Line;
+    Target Kind;
+    size_t Index;
+};
+
+// Only finite numbers; "nan", "inf" and numbers out of range are refused
+static bool ParseFloat(const std::string& word, float& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtof(word.c_str(), &end);
+    return !word.empty() && *end == '\0' && errno != ERANGE && std::isfinite(value);
+}
+
+static bool ParseInt(const std::string& word, int min, int max, int& value)
+{
+    char* end = nullptr;
+    long parsed = std::strtol(word.c_str(), &end, 10);
+    value = (int)parsed;
+    return !word.empty() && *end == '\0' && parsed >= min && parsed <= max;
+}
+
+bool LoadSpeciesConfig(const std::string& fileName, SpeciesConfig& config, std::string& error)
+{
+    std::ifstream file(fileName);
+    if (!file)
+    {
+        error = "Could not open " + fileName;
+        return false;
+    }
+
+    SpeciesConfig loaded;
+    std::unordered_map<std::string, int> speciesIndices;
+    bool hasControl = false;
+    std::vector<SpeciesReference> references;
+
+    std::string line;
+    std::vector<std::string> words;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+    {
+        auto fail = [&](const std::string& problem)
+        {
+            error = fileName + ":" + std::to_string(lineNumber) + ": " + problem;
+            return false;
+        };
+
+        if (!SplitLine(line, words))
+            return fail("unterminated quote");
+        if (words.empty())
+            continue;
+
+        const std::string& keyword = words[0];
+        if (keyword == "species")
+        {
+            // species <id> "<name>" <min> <max> <red> <green> <blue> <size> <speed> [molecules]
+            SpeciesConfig::SpeciesDefinition species;
+            int red, green, blue;
+            if (words.size() < 10 || words.size() > 11)
+                return fail("expected species <id> \"<name>\" <min> <max> <red> <green> <blue> <size> <speed> [molecules]");
+            species.Id = words[1];
+            species.Name = words[2];
+            species.MoleculeCount = 1000;
+            if (!ParseFloat(words[3], species.Min) || !ParseFloat(words[4], species.Max) || species.Max <= species.Min)
+                return fail("min and max must be numbers with min below max");
+            if (!ParseInt(words[5], 0, 255, red) || !ParseInt(words[6], 0, 255, green) || !ParseInt(words[7], 0, 255, blue))
+                return fail("colour components must be 0 to 255");
+            if (!ParseFloat(words[8], species.Size) || species.Size <= 0 || species.Size > 12)
+                return fail("size must be above 0 and at most 12, the largest molecule that fits in the atlas");
+            if (!ParseInt(words[9], 1, 100, species.Speed))
+                return fail("speed must be 1 to 100");
+            if (words.size() == 11 && !ParseInt(words[10], 0, 1000000, species.MoleculeCount))
+                return fail("molecule count must be 0 to 1000000");
+            if (!speciesIndices.emplace(species.Id, (int)loaded.Species.size()).second)
+                return fail("species " + species.Id + " is defined twice");
+
+            species.Color = sf::Color((sf::Uint8)red, (sf::Uint8)green, (sf::Uint8)blue);
+            loaded.Species.push_back(species);
+        }
+        else if (keyword == "control")
+        {
+            // control <id>
+            if (words.size() != 2)
+                return fail("expected control <id>");
+            hasControl = true;
+            references.push_back({ words[1], lineNumber, SpeciesReference::Control, 0 });
+        }
+        else if (keyword == "reaction")
+        {
+            // reaction <id> rises|falls
+            if (words.size() != 3 || (words[2] != "rises" && words[2] != "falls"))
+                return fail("expected reaction <id> rises|falls");
+            references.push_back({ words[1], lineNumber, SpeciesReference::Reaction, loaded.Reactions.size() });
+            loaded.Reactions.push_back({ -1, words[2] == "rises" });
+        }
+        else if (keyword == "legend")
+        {
+            // legend <id> <x> <y> [noshape]
+            SpeciesConfig::LegendLayout legend;
+            if (words.size() < 4 || words.size() > 5 || (words.size() == 5 && words[4] != "noshape"))
+                return fail("expected legend <id> <x> <y> [noshape]");
+            if (!ParseFloat(words[2], legend.Position.x) || !ParseFloat(words[3], legend.Position.y))
+                return fail("legend position must be numbers");
+            references.push_back({ words[1], lineNumber, SpeciesReference::Legend, loaded.Legend.size() });
+            legend.Species = -1;
+            legend.SampleShape = words.size() == 4;
+            loaded.Legend.push_back(legend);
+        }
+        else if (keyword == "text")
+        {
+            // text <size> <x> <y> "<text>"
+            SpeciesConfig::TextLayout text;
+            int size;
+            if (words.size() != 5 || !ParseInt(words[1], 1, 200, size) || !ParseFloat(words[2], text.Position.x) || !ParseFloat(words[3], text.Position.y))
+                return fail("expected text <size> <x> <y> \"<text>\"");
+            text.Size = (unsigned int)size;
+            text.String = words[4];
+            loaded.Texts.push_back(text);
+        }
+        else
+        {
+            return fail("unknown keyword " + keyword);
+        }
+    }
+
+    // Resolve the species references now that all species are known
+    std::vector<bool> hasReaction(loaded.Species.size(), false);
+    for (const SpeciesReference& reference : references)
+    {
+        auto found = speciesIndices.find(reference.Id);
+        if (found == speciesIndices.end())
+        {
+            error = fileName + ":" + std::to_string(reference.Line) + ": unknown species " + reference.Id;
+            return false;
+        }
+
+        switch (reference.Kind)
+        {
+        case SpeciesReference::Control:
+            loaded.ControlSpecies = found->second;
+            break;
+        case SpeciesReference::Reaction:
+            if (hasReaction[found->second])
+            {
+                error = fileName + ":" + std::to_string(reference.Line) + ": species " + reference.Id + " already has a reaction";
+                return false;
+            }
+            hasReaction[found->second] = true;
+            loaded.Reactions[reference.Index].Species = found->second;
+            break;
+        case SpeciesReference::Legend:
+            loaded.Legend[reference.Index].Species = found->second;
+            break;
+        }
+    }
+
+    if (loaded.Species.empty() || !hasControl)
+    {
+        error = fileName + ": needs at least one species and a control species";
+        return false;
+    }
+    if (loaded.Species.size() > 255)
+    {
+        error = fileName + ": at most 255 species";
+        return false;
+    }
+    for (const SpeciesConfig::Reaction& reaction : loaded.Reactions)
+    {
+        if (reaction.Species == loaded.ControlSpecies)
+        {
+            error = fileName + ": the control species cannot have a reaction";
+            return false;
+        }
+    }
+
+    config = std::move(loaded);
+    return true;
+}
+
+// FNV-1a over the bytes of each value
+static void HashBytes(uint32_t& hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+}
+
+uint32_t GetSpeciesConfigHash(const SpeciesConfig& config)
+{
+    uint32_t hash = 2166136261u;
+    for (const SpeciesConfig::SpeciesDefinition& species : config.Species)
+    {
+        HashBytes(hash, species.Id.data(), species.Id.size() + 1);
+        HashBytes(hash, &species.Min, sizeof(species.Min));
+        HashBytes(hash, &species.Max, sizeof(species.Max));
+        HashBytes(hash, &species.Size, sizeof(species.Size));
+        HashBytes(hash, &species.Speed, sizeof(species.Speed));
+        HashBytes(hash, &species.MoleculeCount, sizeof(species.MoleculeCount));
+    }
+    HashBytes(hash, &config.ControlSpecies, sizeof(config.ControlSpecies));
+    for (const SpeciesConfig::Reaction& reaction : config.Reactions)
+    {
+        uint8_t rises = reaction.Rises ? 1 : 0;
+        HashBytes(hash, &reaction.Species, sizeof(reaction.Species));
+        HashBytes(hash, &rises, sizeof(rises));
+    }
+    return hash;
+}
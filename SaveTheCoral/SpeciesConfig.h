@@ -0,0 +1,56 @@
+#pragma once
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Species, chemistry and menu layout as loaded from a configuration file. Loading resolves every reference to an
+// index into Species and checks every value, so nothing is parsed or looked up by name after that.
+struct SpeciesConfig
+{
+    struct SpeciesDefinition
+    {
+        std::string Id;
+        std::string Name;
+        float Min = 0;
+        float Max = 1;
+        sf::Color Color = sf::Color::Black;
+        float Size = 5;
+        int Speed = 1;
+        int MoleculeCount = 0;
+    };
+
+    // The level follows the control species' position within its range, rising with it or falling
+    struct Reaction
+    {
+        int Species = 0;
+        bool Rises = true;
+    };
+
+    struct LegendLayout
+    {
+        int Species = 0;
+        sf::Vector2f Position;
+        bool SampleShape = true;
+    };
+
+    struct TextLayout
+    {
+        unsigned int Size = 20;
+        sf::Vector2f Position;
+        std::string String;
+    };
+
+    std::vector<SpeciesDefinition> Species;
+    int ControlSpecies = 0;
+    std::vector<Reaction> Reactions;
+    std::vector<LegendLayout> Legend;
+    std::vector<TextLayout> Texts;
+};
+
+// Returns false with the first problem found in error, in which case config is left unchanged
+bool LoadSpeciesConfig(const std::string& fileName, SpeciesConfig& config, std::string& error);
+
+// Hash of everything in the configuration the simulation depends on, leaving out the colors, legend and text
+uint32_t GetSpeciesConfigHash(const SpeciesConfig& config);
@@ -0,0 +1,220 @@
+#include "Telemetry.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <iostream>
+
+// Packets a client may have waiting before the oldest unsent one is dropped
+const size_t maxQueuedPackets = 16;
+
+bool TelemetryServer::Start(unsigned short port, float rate)
+{
+    if (listener.listen(port) != sf::Socket::Done)
+        return false;
+
+    listener.setBlocking(false);
+    selector.add(listener);
+    sampleInterval = 1.0f / rate;
+    running = true;
+    std::cout << "Telemetry server listening on port " << port << std::endl;
+    return true;
+}
+
+void TelemetryServer::Stop()
+{
+    selector.clear();
+    clients.clear();
+    listener.close();
+    running = false;
+}
+
+size_t TelemetryServer::GetClientCount() const
+{
+    return clients.size();
+}
+
+void TelemetryServer::Update(const SimulationSnapshot& snapshot, float frameTime, float stepsPerSecond)
+{
+    if (!running)
+        return;
+
+    AcceptClients();
+
+    if (!clients.empty() && sampleClock.getElapsedTime().asSeconds() >= sampleInterval)
+    {
+        sampleClock.restart();
+
+        sf::Packet packet;
+        packet << telemetryMagic << telemetryVersion << (sf::Uint8)TelemetrySample;
+        packet << (sf::Uint64)snapshot.Step << frameTime << stepsPerSecond << (sf::Uint8)snapshot.Species.size();
+        for (const SimulationSnapshot::SpeciesState& species : snapshot.Species)
+            packet << species.Level << (sf::Uint32)species.X.size();
+
+        for (Client& client : clients)
+            Enqueue(client, packet);
+    }
+
+    // Send what the sockets accept and forget the clients that went away
+    for (size_t i = 0; i < clients.size();)
+    {
+        if (Flush(clients[i]))
+        {
+            i++;
+            continue;
+        }
+
+        selector.remove(*clients[i].Socket);
+        clients.erase(clients.begin() + i);
+    }
+}
+
+void TelemetryServer::AcceptClients()
+{
+    // Only poll; a zero timeout would make the selector wait forever
+    if (!selector.wait(sf::microseconds(1)))
+        return;
+
+    if (selector.isReady(listener))
+    {
+        auto socket = std::make_unique<sf::TcpSocket>();
+        while (listener.accept(*socket) == sf::Socket::Done)
+        {
+            socket->setBlocking(false);
+            selector.add(*socket);
+
+            Client client;
+            client.Socket = std::move(socket);
+
+            client.Queue.push_back(CreateHeader());
+
+            clients.push_back(std::move(client));
+            socket = std::make_unique<sf::TcpSocket>();
+        }
+    }
+
+    // Clients are not expected to send anything; reading tells whether they disconnected
+    for (Client& client : clients)
+    {
+        if (!selector.isReady(*client.Socket))
+            continue;
+
+        char buffer[256];
+        std::size_t received = 0;
+        sf::Socket::Status status = client.Socket->receive(buffer, sizeof(buffer), received);
+        if (status == sf::Socket::Disconnected || status == sf::Socket::Error)
+            client.Connected = false;
+    }
+}
+
+sf::Packet TelemetryServer::CreateHeader() const
+{
+    sf::Packet header;
+    header << telemetryMagic << telemetryVersion << (sf::Uint8)TelemetryHeader << (sf::Uint8)allSpecies.size();
+    for (const VariableData* data : allSpecies)
+        header << data->Name << data->Min << data->Max;
+    return header;
+}
+
+void TelemetryServer::SendHeader()
+{
+    sf::Packet header = CreateHeader();
+    for (Client& client : clients)
+        Enqueue(client, header);
+}
+
+// Message type of a packet, after the magic and the version
+static bool IsHeader(const sf::Packet& packet)
+{
+    const size_t typeOffset = sizeof(sf::Uint32) + sizeof(sf::Uint8);
+    return packet.getDataSize() > typeOffset && ((const sf::Uint8*)packet.getData())[typeOffset] == TelemetryHeader;
+}
+
+void TelemetryServer::Enqueue(Client& client, const sf::Packet& packet)
+{
+    if (client.Queue.size() >= maxQueuedPackets)
+    {
+        // Drop the oldest sample, never a header: the samples after it would be read with the wrong species. The
+        // front packet may be partially sent already, so it stays.
+        auto oldest = std::find_if(client.Queue.begin() + 1, client.Queue.end(), [](const sf::Packet& queued) { return !IsHeader(queued); });
+        if (oldest != client.Queue.end())
+        {
+            client.Queue.erase(oldest);
+            DroppedSamples++;
+        }
+        else if (!IsHeader(packet))
+        {
+            DroppedSamples++;
+            return;
+        }
+    }
+    client.Queue.push_back(packet);
+}
+
+bool TelemetryServer::Flush(Client& client)
+{
+    if (!client.Connected)
+        return false;
+
+    while (!client.Queue.empty())
+    {
+        sf::Socket::Status status = client.Socket->send(client.Queue.front());
+        if (status == sf::Socket::Done)
+            client.Queue.pop_front();
+        else if (status == sf::Socket::Partial || status == sf::Socket::NotReady)
+            return true;
+        else
+            return false;
+    }
+    return true;
+}
+
+void RunTelemetryClient(const std::string& host, unsigned short port)
+{
+    sf::TcpSocket socket;
+    if (socket.connect(host, port, sf::seconds(5)) != sf::Socket::Done)
+    {
+        std::cout << "Could not connect to telemetry server " << host << ":" << port << std::endl;
+        return;
+    }
+
+    std::vector<std::string> names;
+    sf::Packet packet;
+    while (socket.receive(packet) == sf::Socket::Done)
+    {
+        sf::Uint32 magic = 0;
+        sf::Uint8 version = 0;
+        sf::Uint8 type = 0;
+        sf::Uint8 speciesCount = 0;
+        if (!(packet >> magic >> version >> type) || magic != telemetryMagic || version != telemetryVersion)
+            continue;
+
+        if (type == TelemetryHeader && packet >> speciesCount)
+        {
+            names.clear();
+            for (int s = 0; s < speciesCount; s++)
+            {
+                sf::String name;
+                float min = 0;
+                float max = 0;
+                packet >> name >> min >> max;
+                names.push_back(name.toAnsiString());
+            }
+        }
+        else if (type == TelemetrySample)
+        {
+            sf::Uint64 step = 0;
+            float frameTime = 0;
+            float stepsPerSecond = 0;
+            packet >> step >> frameTime >> stepsPerSecond >> speciesCount;
+
+            std::cout << "step " << step << ", frame " << frameTime * 1000 << " ms, " << stepsPerSecond << " steps/s";
+            for (int s = 0; s < speciesCount; s++)
+            {
+                float level = 0;
+                sf::Uint32 molecules = 0;
+                packet >> level >> molecules;
+                std::cout << "; " << (s < (int)names.size() ? names[s] : "?") << " " << level << " (" << molecules << ")";
+            }
+            std::cout << std::endl;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <SFML/System/Clock.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SimulationThread.h"
+
+// Identifies telemetry packets, followed by the message type
+const sf::Uint32 telemetryMagic = 0x53544354; // "STCT"
+const sf::Uint8 telemetryVersion = 1;
+
+enum TelemetryMessage
+{
+    // Sent on connect and whenever the species change: species count, then name, min and max of each species
+    TelemetryHeader = 0,
+    // Sent at the telemetry rate: step, frame time, steps per second, then level and molecule count of each species
+    TelemetrySample = 1
+};
+
+// Streams simulation samples to any number of TCP clients. Everything is non-blocking and every client has a
+// bounded send queue, so a slow client loses samples instead of stalling the render loop.
+struct TelemetryServer
+{
+    // Samples dropped because a client's queue was full
+    uint64_t DroppedSamples = 0;
+
+    bool Start(unsigned short port, float rate);
+    void Stop();
+
+    // Call once per frame: accepts new clients, queues a sample when one is due and sends as much as the sockets take
+    void Update(const SimulationSnapshot& snapshot, float frameTime, float stepsPerSecond);
+
+    size_t GetClientCount() const;
+
+    // Send the species again, after they changed
+    void SendHeader();
+
+private:
+    struct Client
+    {
+        std::unique_ptr<sf::TcpSocket> Socket;
+        std::deque<sf::Packet> Queue;
+        bool Connected = true;
+    };
+
+    void AcceptClients();
+    sf::Packet CreateHeader() const;
+    void Enqueue(Client& client, const sf::Packet& packet);
+    bool Flush(Client& client);
+
+    sf::TcpListener listener;
+    sf::SocketSelector selector;
+    std::vector<Client> clients;
+    sf::Clock sampleClock;
+    float sampleInterval = 0.1f;
+    bool running = false;
+};
+
+// Connect to a telemetry server and print what it sends until the connection closes
+void RunTelemetryClient(const std::string& host, unsigned short port);
@@ -0,0 +1,249 @@
+#include "TemperatureField.h"
+#include "ChemistryGrid.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+
+TemperatureField waterTemperatureField;
+
+// How fast heat spreads, in cells squared per step; the explicit chemistry would only be stable up to 0.25 per solve
+const float thermalDiffusivity = 0.15f;
+
+// Fraction of its warmth above the deep ocean the water gives off per step
+const float coolingRate = 0.002f;
+
+// How warm the sunlit surface gets without any carbon dioxide, relative to with the most
+const float baseWarmth = 0.2f;
+
+// Warmth the sun brings to the surface with the most carbon dioxide; some of it spreads down, so it is more than 1
+const float sunStrength = 1.5f;
+
+// Sunlight fades with depth over this share of the reef's height, and this share of it reaches the seabed anyway
+const float absorptionDepth = 0.3f;
+const float deepLight = 0.25f;
+
+// Rows or columns per job; the corrections of the cyclic solves are buffered for one job at a time
+const int temperatureLinesPerJob = 16;
+
+void TemperatureField::Tridiagonal::Factor(const std::vector<float>& diagonal, float offDiagonal)
+{
+    size_t size = diagonal.size();
+    OffDiagonal = offDiagonal;
+    Upper.resize(size);
+    Inverse.resize(size);
+
+    Inverse[0] = 1.0f / diagonal[0];
+    Upper[0] = offDiagonal * Inverse[0];
+    for (size_t i = 1; i < size; i++)
+    {
+        Inverse[i] = 1.0f / (diagonal[i] - offDiagonal * Upper[i - 1]);
+        Upper[i] = offDiagonal * Inverse[i];
+    }
+}
+
+void TemperatureField::Tridiagonal::Solve(float* values, int stride, int begin, int end) const
+{
+    int size = (int)Upper.size();
+
+    // Eliminate below the diagonal going down, then substitute back going up; each pass over j vectorizes
+    float* row = values + begin;
+    for (int j = 0; j < end - begin; j++)
+        row[j] *= Inverse[0];
+    for (int i = 1; i < size; i++)
+    {
+        const float* previous = values + (size_t)(i - 1) * stride + begin;
+        float* current = values + (size_t)i * stride + begin;
+        float inverse = Inverse[i];
+        for (int j = 0; j < end - begin; j++)
+            current[j] = (current[j] - OffDiagonal * previous[j]) * inverse;
+    }
+    for (int i = size - 2; i >= 0; i--)
+    {
+        const float* next = values + (size_t)(i + 1) * stride + begin;
+        float* current = values + (size_t)i * stride + begin;
+        float upper = Upper[i];
+        for (int j = 0; j < end - begin; j++)
+            current[j] -= upper * next[j];
+    }
+}
+
+void TemperatureField::Initialize(uint32_t seed, float carbonDioxide)
+{
+    Width = std::max((int)std::lround(reefRect.width / chemistryCellSize), 3);
+    Height = std::max((int)std::lround(reefRect.height / chemistryCellSize), 3);
+    size_t cells = (size_t)Width * Height;
+    transposed.assign(cells, 0.0f);
+    Quantized.assign(cells, 0);
+
+    // Clouds and shelter as two waves across the reef, so they wrap around like the reef does
+    Random random(seed ^ 0x7e3bu);
+    float phase1 = random.NextInt(6283) / 1000.0f;
+    float phase2 = random.NextInt(6283) / 1000.0f;
+    sunlight.resize(cells);
+    double sunlightSum = 0;
+    for (int y = 0; y < Height; y++)
+    {
+        float depth = (y + 0.5f) / Height;
+        float light = deepLight + (1 - deepLight) * std::exp(-depth / absorptionDepth);
+        for (int x = 0; x < Width; x++)
+        {
+            float angle = 6.2831853f * x / Width;
+            float shade = 0.85f + 0.1f * std::sin(angle + phase1) + 0.05f * std::sin(2 * angle + phase2);
+            sunlight[y * Width + x] = light * shade;
+            sunlightSum += light * shade;
+        }
+    }
+    meanSunlight = (float)(sunlightSum / cells);
+
+    // Start close to where the water settles
+    float warmth = baseWarmth + (1 - baseWarmth) * std::clamp(carbonDioxide, 0.0f, 1.0f);
+    Values.resize(cells);
+    for (size_t i = 0; i < cells; i++)
+    {
+        Values[i] = warmth * sunlight[i];
+        Quantized[i] = (uint8_t)std::lrint(std::clamp(Values[i], 0.0f, 1.0f) * 255.0f);
+    }
+    Version++;
+
+    // Each half step is half the solve, with half of the cooling in each direction
+    float halfStep = 0.5f * temperatureStepInterval;
+    float spread = halfStep * thermalDiffusivity;
+    float cooling = 0.5f * halfStep * coolingRate;
+
+    // Across: cyclic, solved by Sherman-Morrison as a plain system with the corners moved onto the diagonal
+    std::vector<float> diagonal(Width, 1 + 2 * spread + cooling);
+    float gamma = -diagonal[0];
+    float corner = -spread;
+    diagonal[0] -= gamma;
+    diagonal[Width - 1] -= corner * corner / gamma;
+    acrossSystem.Factor(diagonal, -spread);
+    acrossCorrection.assign(Width, 0.0f);
+    acrossCorrection[0] = gamma;
+    acrossCorrection[Width - 1] = corner;
+    acrossSystem.Solve(acrossCorrection.data(), 1, 0, 1);
+    acrossCorner = corner / gamma;
+    acrossCorrectionScale = 1.0f / (1 + acrossCorrection[0] + acrossCorner * acrossCorrection[Width - 1]);
+
+    // Down: the surface and seabed rows only have one neighbour to exchange heat with
+    diagonal.assign(Height, 1 + 2 * spread + cooling);
+    diagonal[0] = diagonal[Height - 1] = 1 + spread + cooling;
+    downSystem.Factor(diagonal, -spread);
+}
+
+void TemperatureField::Solve(JobSystem& jobs, float carbonDioxide)
+{
+    float halfStep = 0.5f * temperatureStepInterval;
+    float spread = halfStep * thermalDiffusivity;
+    float cooling = 0.5f * halfStep * coolingRate;
+    float heating = halfStep * coolingRate * sunStrength * (baseWarmth + (1 - baseWarmth) * std::clamp(carbonDioxide, 0.0f, 1.0f));
+    int width = Width;
+    int height = Height;
+    float* values = Values.data();
+    float* columns = transposed.data();
+    const float* light = sunlight.data();
+
+    // First half: spread down the reef explicitly, into columns so the solve across runs over neighbouring values
+    jobs.ParallelFor(width, temperatureLinesPerJob, [=](int begin, int end)
+    {
+        for (int x = begin; x < end; x++)
+        {
+            float* column = columns + (size_t)x * height;
+            for (int y = 0; y < height; y++)
+            {
+                float value = values[y * width + x];
+                float above = values[std::max(y - 1, 0) * width + x];
+                float below = values[std::min(y + 1, height - 1) * width + x];
+                column[y] = value + spread * (above + below - 2 * value) - cooling * value + heating * light[y * width + x];
+            }
+        }
+    });
+    jobs.ParallelFor(height, temperatureLinesPerJob, [this, columns, width, height](int begin, int end)
+    {
+        acrossSystem.Solve(columns, height, begin, end);
+
+        float correction[temperatureLinesPerJob];
+        for (int y = begin; y < end; y++)
+            correction[y - begin] = (columns[y] + acrossCorner * columns[(size_t)(width - 1) * height + y]) * acrossCorrectionScale;
+        for (int x = 0; x < width; x++)
+        {
+            float* column = columns + (size_t)x * height;
+            float share = acrossCorrection[x];
+            for (int y = begin; y < end; y++)
+                column[y] -= correction[y - begin] * share;
+        }
+    });
+
+    // Second half: spread across the reef explicitly, back into rows, and solve down the reef
+    jobs.ParallelFor(height, temperatureLinesPerJob, [=](int begin, int end)
+    {
+        for (int y = begin; y < end; y++)
+        {
+            float* row = values + (size_t)y * width;
+            for (int x = 0; x < width; x++)
+            {
+                float value = columns[(size_t)x * height + y];
+                float left = columns[(size_t)(x == 0 ? width - 1 : x - 1) * height + y];
+                float right = columns[(size_t)(x == width - 1 ? 0 : x + 1) * height + y];
+                row[x] = value + spread * (left + right - 2 * value) - cooling * value + heating * light[y * width + x];
+            }
+        }
+    });
+    jobs.ParallelFor(width, temperatureLinesPerJob, [this, values, width](int begin, int end)
+    {
+        downSystem.Solve(values, width, begin, end);
+    });
+
+    for (size_t i = 0; i < Values.size(); i++)
+        Quantized[i] = (uint8_t)std::lrint(std::clamp(Values[i], 0.0f, 1.0f) * 255.0f);
+    Version++;
+}
+
+float TemperatureField::GetSettledMean(float carbonDioxide) const
+{
+    return sunStrength * (baseWarmth + (1 - baseWarmth) * std::clamp(carbonDioxide, 0.0f, 1.0f)) * meanSunlight;
+}
+
+float TemperatureField::Sample(float x, float y) const
+{
+    if (Width == 0)
+        return 0;
+
+    // Cell coordinates relative to the cell centers, wrapping across and clamped down
+    float cellX = (x - reefRect.left) * Width / reefRect.width - 0.5f;
+    float cellY = std::clamp((y - reefRect.top) * Height / reefRect.height - 0.5f, 0.0f, (float)(Height - 1));
+    float floorX = std::floor(cellX);
+    float tx = cellX - floorX;
+    int x0 = (int)floorX % Width;
+    if (x0 < 0)
+        x0 += Width;
+    int x1 = x0 + 1 == Width ? 0 : x0 + 1;
+    int y0 = std::min((int)cellY, Height - 2);
+    float ty = cellY - y0;
+
+    const float* row0 = Values.data() + y0 * Width;
+    const float* row1 = row0 + Width;
+    float top = row0[x0] + (row0[x1] - row0[x0]) * tx;
+    float bottom = row1[x0] + (row1[x1] - row1[x0]) * tx;
+    return top + (bottom - top) * ty;
+}
+
+void TemperatureField::Store(VariableData& data, int current) const
+{
+    std::vector<float>& concentration = data.Concentration[current];
+    if (concentration.size() != Values.size())
+        return;
+
+    for (size_t i = 0; i < Values.size(); i++)
+        concentration[i] = data.Min + data.GetRange() * std::clamp(Values[i], 0.0f, 1.0f);
+}
+
+void TemperatureState::CopyFrom(const TemperatureField& temperature)
+{
+    if (Version == temperature.Version && Width == temperature.Width)
+        return;
+
+    Width = temperature.Width;
+    Height = temperature.Height;
+    Values = temperature.Quantized;
+    Version = temperature.Version;
+}
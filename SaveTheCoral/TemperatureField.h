@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "JobSystem.h"
+
+struct VariableData;
+
+// Steps between two solves of the temperature field. The solver is implicit, so it stays stable however long the
+// step, and solving rarely keeps fast-forwarding cheap.
+const int temperatureStepInterval = 10;
+
+// Water temperature over reefRect on the chemistry grid, from 0 (the species' Min, deep cold water) to 1 (its Max).
+// The sun warms the water from the surface, more so the more carbon dioxide there is in the air, the heat spreads
+// out, and the water gives it off towards the cold deep ocean. Cloud and shelter make the sun warm some stretches of
+// the reef more than others.
+//
+// Each solve is one alternating direction implicit (Peaceman-Rachford) step: half a step implicit across the reef
+// and half a step implicit down it. Every half step is a tridiagonal system per row or column, solved with the
+// Thomas algorithm for many rows or columns at once, so the innermost loops run over neighbouring values and vectorize.
+struct TemperatureField
+{
+    int Width = 0;
+    int Height = 0;
+
+    // Relative temperature per cell, row by row
+    std::vector<float> Values;
+
+    // Quantized to bytes for the heatmap, and a version that changes with every solve
+    std::vector<uint8_t> Quantized;
+    uint64_t Version = 0;
+
+    // Size the field to the chemistry grid and start it at the balance for the given relative carbon dioxide level
+    void Initialize(uint32_t seed, float carbonDioxide);
+
+    // Solve temperatureStepInterval steps at once, heated for the given relative carbon dioxide level from 0 to 1
+    void Solve(JobSystem& jobs, float carbonDioxide);
+
+    // Mean relative temperature the field settles at for a relative carbon dioxide level. The heat only spreads within
+    // the reef, so this is the mean heating over the cooling, wherever the heat ends up.
+    float GetSettledMean(float carbonDioxide) const;
+
+    // Relative temperature at a position in layout units, interpolated between the cell centers; 0 before Initialize
+    float Sample(float x, float y) const;
+
+    // Write the temperature into a species' current concentrations, in the species' own range
+    void Store(VariableData& data, int current) const;
+
+private:
+    // Constant coefficient tridiagonal system, factored once. A system of size n is solved for many right hand sides
+    // at once, which are interleaved: value i of right hand side j is at values[i * stride + j].
+    struct Tridiagonal
+    {
+        float OffDiagonal = 0;
+        std::vector<float> Upper;
+        std::vector<float> Inverse;
+
+        void Factor(const std::vector<float>& diagonal, float offDiagonal);
+        void Solve(float* values, int stride, int begin, int end) const;
+    };
+
+    // Share of the full sunlight each cell gets, and its mean
+    std::vector<float> sunlight;
+    float meanSunlight = 0;
+
+    // Half step results, column by column
+    std::vector<float> transposed;
+
+    // Across the reef the field wraps around, so the system is cyclic; it is solved as a plain one plus a correction
+    Tridiagonal acrossSystem;
+    std::vector<float> acrossCorrection;
+    float acrossCorner = 0;
+    float acrossCorrectionScale = 0;
+
+    // Down the reef the surface and the seabed let no heat through
+    Tridiagonal downSystem;
+};
+
+// A copy of the quantized temperature for the renderer
+struct TemperatureState
+{
+    int Width = 0;
+    int Height = 0;
+    std::vector<uint8_t> Values;
+    uint64_t Version = 0;
+
+    void CopyFrom(const TemperatureField& temperature);
+};
+
+extern TemperatureField waterTemperatureField;
@@ -0,0 +1,88 @@
+#include "TextBatch.h"
+
+void PrewarmGlyphs(const sf::Font& font, const sf::String& characters, const std::vector<unsigned int>& characterSizes,
+    const std::vector<float>& outlineThicknesses)
+{
+    for (unsigned int characterSize : characterSizes)
+    {
+        for (float outlineThickness : outlineThicknesses)
+        {
+            for (sf::Uint32 character : characters)
+                font.getGlyph(character, characterSize, false, outlineThickness);
+        }
+    }
+}
+
+void TextBatch::Clear()
+{
+    batches.clear();
+}
+
+void TextBatch::Add(const sf::String& string, unsigned int characterSize, sf::Vector2f position, sf::Color color)
+{
+    if (!Font)
+        return;
+
+    sf::VertexArray& vertices = batches[characterSize];
+    vertices.setPrimitiveType(sf::Triangles);
+
+    // Same metrics and glyph padding as sf::Text, so batched text looks identical
+    float lineSpacing = Font->getLineSpacing(characterSize);
+    float padding = 1.0f;
+    float x = 0;
+    float y = (float)characterSize;
+    sf::Uint32 previousCharacter = 0;
+
+    for (sf::Uint32 character : string)
+    {
+        x += Font->getKerning(previousCharacter, character, characterSize);
+        previousCharacter = character;
+
+        if (character == '\n')
+        {
+            x = 0;
+            y += lineSpacing;
+            continue;
+        }
+
+        // Like sf::Text, no quads for glyphs that draw nothing, such as spaces
+        const sf::Glyph& glyph = Font->getGlyph(character, characterSize, false);
+        if (glyph.textureRect.width == 0 || glyph.textureRect.height == 0)
+        {
+            x += glyph.advance;
+            continue;
+        }
+
+        float left = position.x + x + glyph.bounds.left - padding;
+        float top = position.y + y + glyph.bounds.top - padding;
+        float right = position.x + x + glyph.bounds.left + glyph.bounds.width + padding;
+        float bottom = position.y + y + glyph.bounds.top + glyph.bounds.height + padding;
+
+        float u1 = glyph.textureRect.left - padding;
+        float v1 = glyph.textureRect.top - padding;
+        float u2 = glyph.textureRect.left + glyph.textureRect.width + padding;
+        float v2 = glyph.textureRect.top + glyph.textureRect.height + padding;
+
+        vertices.append(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+        vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+        vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+        vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+        vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+        vertices.append(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+
+        x += glyph.advance;
+    }
+}
+
+void TextBatch::Draw(sf::RenderTarget& target) const
+{
+    if (!Font)
+        return;
+
+    for (const auto& batch : batches)
+    {
+        sf::RenderStates states;
+        states.texture = &Font->getTexture(batch.first);
+        target.draw(batch.second, states);
+    }
+}
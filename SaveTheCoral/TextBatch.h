@@ -0,0 +1,27 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <map>
+#include <vector>
+
+// Rasterize every character of the given set at each of the given sizes and outline thicknesses (0 for none) into
+// the font's glyph textures. Meant to run on a worker thread at startup; nothing else may use the font until it has
+// finished.
+void PrewarmGlyphs(const sf::Font& font, const sf::String& characters, const std::vector<unsigned int>& characterSizes,
+    const std::vector<float>& outlineThicknesses);
+
+// Static text laid out once into a vertex array per character size, so all of it draws in one call per size
+struct TextBatch
+{
+    const sf::Font* Font = nullptr;
+
+    void Clear();
+
+    // Lay out a string the same way sf::Text would, with its top-left corner at the given position
+    void Add(const sf::String& string, unsigned int characterSize, sf::Vector2f position, sf::Color color);
+
+    void Draw(sf::RenderTarget& target) const;
+
+private:
+    // The font keeps a separate glyph texture per character size, hence a batch per size
+    std::map<unsigned int, sf::VertexArray> batches;
+};
@@ -0,0 +1,209 @@
+#include "TimeSeries.h"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+const char timeSeriesMagic[4] = { 'S', 'T', 'T', 'S' };
+const uint8_t timeSeriesVersion = 1;
+
+// Rows per chunk, and chunks that may wait for the writer thread; together they bound the memory used
+const uint32_t chunkRows = 4096;
+const size_t maxQueuedChunks = 4;
+
+template <typename T>
+static void Write(std::ofstream& file, T value)
+{
+    file.write((const char*)&value, sizeof(value));
+}
+
+template <typename T>
+static bool Read(std::ifstream& file, T& value)
+{
+    return (bool)file.read((char*)&value, sizeof(value));
+}
+
+bool TimeSeriesWriter::Start(const std::string& fileName, const std::vector<std::string>& columns)
+{
+    file.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file.write(timeSeriesMagic, sizeof(timeSeriesMagic));
+    Write(file, timeSeriesVersion);
+    Write(file, (uint32_t)columns.size());
+    for (const std::string& column : columns)
+    {
+        Write(file, (uint32_t)column.size());
+        file.write(column.data(), column.size());
+    }
+
+    columnCount = columns.size();
+    current.RowCount = 0;
+    current.Values.resize(columnCount * chunkRows);
+    stopping = false;
+    running = true;
+    thread = std::thread(&TimeSeriesWriter::Run, this);
+    return true;
+}
+
+void TimeSeriesWriter::Add(uint64_t step, const std::vector<float>& values)
+{
+    if (!running)
+        return;
+
+    if (current.RowCount == 0)
+        current.FirstStep = step;
+    for (size_t c = 0; c < columnCount; c++)
+        current.Values[c * chunkRows + current.RowCount] = c < values.size() ? values[c] : std::numeric_limits<float>::quiet_NaN();
+
+    if (++current.RowCount == chunkRows)
+        Submit();
+}
+
+void TimeSeriesWriter::Submit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size() >= maxQueuedChunks)
+    {
+        Stalls++;
+        queueChanged.wait(lock, [this] { return queue.size() < maxQueuedChunks; });
+    }
+    queue.push_back(std::move(current));
+
+    // Reuse a chunk the writer is done with instead of allocating
+    if (!freeChunks.empty())
+    {
+        current = std::move(freeChunks.back());
+        freeChunks.pop_back();
+    }
+    else
+    {
+        current = Chunk();
+        current.Values.resize(columnCount * chunkRows);
+    }
+    current.RowCount = 0;
+    queueChanged.notify_all();
+}
+
+void TimeSeriesWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        queueChanged.wait(lock, [this] { return !queue.empty() || stopping; });
+        if (queue.empty())
+            break;
+
+        Chunk chunk = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        Write(file, chunk.RowCount);
+        Write(file, chunk.FirstStep);
+        for (size_t c = 0; c < columnCount; c++)
+            file.write((const char*)&chunk.Values[c * chunkRows], chunk.RowCount * sizeof(float));
+        file.flush();
+
+        lock.lock();
+        freeChunks.push_back(std::move(chunk));
+        queueChanged.notify_all();
+    }
+}
+
+void TimeSeriesWriter::Stop()
+{
+    if (!running)
+        return;
+
+    if (current.RowCount > 0)
+        Submit();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    thread.join();
+    file.close();
+    running = false;
+
+    if (Stalls > 0)
+        std::printf("The level log held up the simulation %llu times waiting for the disk\n", (unsigned long long)Stalls);
+}
+
+TimeSeriesWriter::~TimeSeriesWriter()
+{
+    Stop();
+}
+
+bool TimeSeriesReader::Open(const std::string& fileName)
+{
+    file.open(fileName, std::ios::binary);
+    char magic[sizeof(timeSeriesMagic)];
+    uint8_t version = 0;
+    uint32_t columnCount = 0;
+    if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), timeSeriesMagic))
+        return false;
+    if (!Read(file, version) || version != timeSeriesVersion || !Read(file, columnCount))
+        return false;
+
+    Columns.clear();
+    for (uint32_t c = 0; c < columnCount; c++)
+    {
+        uint32_t length = 0;
+        if (!Read(file, length) || length > 1024)
+            return false;
+
+        std::string name(length, '\0');
+        if (!file.read(&name[0], length))
+            return false;
+        Columns.push_back(name);
+    }
+    return true;
+}
+
+bool TimeSeriesReader::ReadChunk(Chunk& chunk)
+{
+    if (!Read(file, chunk.RowCount) || !Read(file, chunk.FirstStep) || chunk.RowCount > chunkRows)
+        return false;
+
+    chunk.Columns.resize(Columns.size());
+    for (std::vector<float>& column : chunk.Columns)
+    {
+        column.resize(chunk.RowCount);
+        if (!file.read((char*)column.data(), chunk.RowCount * sizeof(float)))
+            return false;
+    }
+    return true;
+}
+
+bool ConvertTimeSeriesToCsv(const std::string& inputFileName, const std::string& outputFileName)
+{
+    TimeSeriesReader reader;
+    if (!reader.Open(inputFileName))
+        return false;
+
+    FILE* output = std::fopen(outputFileName.c_str(), "w");
+    if (!output)
+        return false;
+
+    std::fprintf(output, "Step");
+    for (const std::string& column : reader.Columns)
+        std::fprintf(output, ",%s", column.c_str());
+    std::fprintf(output, "\n");
+
+    TimeSeriesReader::Chunk chunk;
+    while (reader.ReadChunk(chunk))
+    {
+        for (uint32_t row = 0; row < chunk.RowCount; row++)
+        {
+            std::fprintf(output, "%llu", (unsigned long long)(chunk.FirstStep + row));
+            for (const std::vector<float>& column : chunk.Columns)
+                std::fprintf(output, ",%.9g", column[row]);
+            std::fprintf(output, "\n");
+        }
+    }
+
+    std::fclose(output);
+    return true;
+}
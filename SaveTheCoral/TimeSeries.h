@@ -0,0 +1,81 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Append-only columnar log of one float per column per simulation step. Rows are gathered into chunks that a
+// background thread writes out, so logging costs the simulation a few stores per step.
+//
+// Layout (little-endian): "STTS", version byte, uint32 column count, per column a uint32 length and the name,
+// then chunks of uint32 row count, uint64 step of the first row and the columns one after the other as floats.
+// Rows in a chunk are consecutive steps. A chunk cut short by a crash is ignored by the reader.
+struct TimeSeriesWriter
+{
+    // Times Add had to wait because the writer thread was behind; printed by Stop
+    uint64_t Stalls = 0;
+
+    bool Start(const std::string& fileName, const std::vector<std::string>& columns);
+
+    // Append one row of values, one per column; rows must be consecutive steps. The columns are fixed when the file
+    // is started, so missing values are written as NaN and extra ones are left out.
+    void Add(uint64_t step, const std::vector<float>& values);
+
+    // Write the partial chunk and wait for everything to be on disk; prints the stalls if there were any
+    void Stop();
+
+    ~TimeSeriesWriter();
+
+private:
+    struct Chunk
+    {
+        uint64_t FirstStep = 0;
+        uint32_t RowCount = 0;
+
+        // Column major, each column has room for a full chunk
+        std::vector<float> Values;
+    };
+
+    void Submit();
+    void Run();
+
+    std::ofstream file;
+    size_t columnCount = 0;
+    Chunk current;
+
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Chunk> queue;
+    std::vector<Chunk> freeChunks;
+    std::thread thread;
+    bool stopping = false;
+    bool running = false;
+};
+
+struct TimeSeriesReader
+{
+    struct Chunk
+    {
+        uint64_t FirstStep = 0;
+        uint32_t RowCount = 0;
+        std::vector<std::vector<float>> Columns;
+    };
+
+    std::vector<std::string> Columns;
+
+    bool Open(const std::string& fileName);
+
+    // Read the next chunk; false at the end of the file
+    bool ReadChunk(Chunk& chunk);
+
+private:
+    std::ifstream file;
+};
+
+// Write a time series as CSV with a step column followed by one column per series, with enough digits for every
+// float to read back exactly
+bool ConvertTimeSeriesToCsv(const std::string& inputFileName, const std::string& outputFileName);
@@ -0,0 +1,444 @@
+#include "Trajectory.h"
+#include "Simulation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Carbon dioxide in the air before industry, and today
+const float preIndustrialPpm = 280;
+const float todayPpm = 415;
+
+bool MappedFile::Open(const std::string& fileName)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE fileHandleValue = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandleValue == INVALID_HANDLE_VALUE)
+        return false;
+    fileHandle = fileHandleValue;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandleValue, &fileSize))
+    {
+        Close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+    if (size == 0)
+        return true;
+
+    mappingHandle = CreateFileMappingA(fileHandleValue, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle)
+        data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int descriptor = open(fileName.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0)
+    {
+        close(descriptor);
+        return false;
+    }
+    size = (size_t)status.st_size;
+    if (size == 0)
+    {
+        close(descriptor);
+        return true;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapped != MAP_FAILED)
+        data = (const char*)mapped;
+#endif
+    if (!data)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (data)
+        munmap((void*)data, size);
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+namespace
+{
+    // The next line from the offset without its line break, moving the offset past it; false at the end of the file
+    bool NextLine(const char* data, size_t size, size_t& offset, const char*& begin, const char*& end)
+    {
+        if (offset >= size)
+            return false;
+
+        begin = data + offset;
+        const char* lineBreak = (const char*)std::memchr(begin, '\n', size - offset);
+        end = lineBreak ? lineBreak : data + size;
+        offset = (size_t)(end - data) + (lineBreak ? 1 : 0);
+        if (end > begin && end[-1] == '\r')
+            end--;
+        return true;
+    }
+
+    bool IsDataLine(const char* begin, const char* end)
+    {
+        while (begin < end && (*begin == ' ' || *begin == '\t'))
+            begin++;
+        return begin < end && *begin != '#';
+    }
+
+    // The field up to the next comma with the spaces around it trimmed, moving begin past the comma
+    void NextField(const char*& begin, const char* end, const char*& fieldBegin, const char*& fieldEnd)
+    {
+        const char* comma = (const char*)std::memchr(begin, ',', end - begin);
+        fieldBegin = begin;
+        fieldEnd = comma ? comma : end;
+        begin = comma ? comma + 1 : end;
+        while (fieldBegin < fieldEnd && (*fieldBegin == ' ' || *fieldBegin == '\t'))
+            fieldBegin++;
+        while (fieldEnd > fieldBegin && (fieldEnd[-1] == ' ' || fieldEnd[-1] == '\t'))
+            fieldEnd--;
+    }
+
+    // A plain decimal number such as -12.5 or 3e2 taking up the whole field; the field is not null terminated
+    bool ParseNumber(const char* begin, const char* end, double& value)
+    {
+        bool negative = begin < end && *begin == '-';
+        if (begin < end && (*begin == '-' || *begin == '+'))
+            begin++;
+
+        double number = 0;
+        int digits = 0;
+        for (; begin < end && *begin >= '0' && *begin <= '9'; begin++, digits++)
+            number = number * 10 + (*begin - '0');
+        if (begin < end && *begin == '.')
+        {
+            double scale = 0.1;
+            for (begin++; begin < end && *begin >= '0' && *begin <= '9'; begin++, digits++, scale *= 0.1)
+                number += (*begin - '0') * scale;
+        }
+        if (digits == 0)
+            return false;
+
+        if (begin < end && (*begin == 'e' || *begin == 'E'))
+        {
+            begin++;
+            bool negativeExponent = begin < end && *begin == '-';
+            if (begin < end && (*begin == '-' || *begin == '+'))
+                begin++;
+            int exponent = 0;
+            int exponentDigits = 0;
+            for (; begin < end && *begin >= '0' && *begin <= '9' && exponent < 1000; begin++, exponentDigits++)
+                exponent = exponent * 10 + (*begin - '0');
+            if (exponentDigits == 0)
+                return false;
+            number *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+        }
+
+        value = negative ? -number : number;
+        return begin == end;
+    }
+}
+
+bool TrajectoryData::Open(const std::string& fileName, std::string& error)
+{
+    Scenarios.clear();
+    index.clear();
+    windowYears.clear();
+    windowValues.clear();
+    if (!file.Open(fileName))
+    {
+        error = "Could not open " + fileName;
+        return false;
+    }
+
+    // The header names the columns
+    const char* data = file.GetData();
+    size_t size = file.GetSize();
+    size_t offset = 0;
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    bool hasHeader = false;
+    while (!hasHeader && NextLine(data, size, offset, begin, end))
+        hasHeader = IsDataLine(begin, end);
+    if (!hasHeader)
+    {
+        error = fileName + " is empty";
+        return false;
+    }
+    const char* fieldBegin;
+    const char* fieldEnd;
+    NextField(begin, end, fieldBegin, fieldEnd);
+    if (std::string(fieldBegin, fieldEnd) != "year")
+    {
+        error = fileName + ": the first column must be \"year\"";
+        return false;
+    }
+    while (begin < end)
+    {
+        NextField(begin, end, fieldBegin, fieldEnd);
+        Scenarios.emplace_back(fieldBegin, fieldEnd);
+    }
+    if (Scenarios.empty())
+    {
+        error = fileName + ": there are no scenarios";
+        return false;
+    }
+
+    // Index every so many rows by year; only the year of the indexed rows is parsed
+    int row = 0;
+    double previousYear = -std::numeric_limits<double>::infinity();
+    for (size_t lineOffset = offset; NextLine(data, size, offset, begin, end); lineOffset = offset)
+    {
+        if (!IsDataLine(begin, end) || row++ % trajectoryIndexInterval != 0)
+            continue;
+
+        double year;
+        NextField(begin, end, fieldBegin, fieldEnd);
+        if (!ParseNumber(fieldBegin, fieldEnd, year) || year < previousYear)
+        {
+            error = fileName + ": the years must be numbers in order";
+            return false;
+        }
+        previousYear = year;
+        index.push_back({ year, lineOffset });
+    }
+    if (index.empty())
+    {
+        error = fileName + ": there are no rows";
+        return false;
+    }
+    FirstYear = index.front().Year;
+
+    // The last year is in the rows after the last indexed one
+    size_t lastOffset = index.back().Offset;
+    double year;
+    while (ParseRow(lastOffset, year, rowValues))
+        LastYear = year;
+    return true;
+}
+
+int TrajectoryData::FindScenario(const std::string& name) const
+{
+    auto found = std::find(Scenarios.begin(), Scenarios.end(), name);
+    return found == Scenarios.end() ? -1 : (int)(found - Scenarios.begin());
+}
+
+bool TrajectoryData::ParseRow(size_t& offset, double& year, std::vector<float>& values) const
+{
+    const char* begin;
+    const char* end;
+    do
+    {
+        if (!NextLine(file.GetData(), file.GetSize(), offset, begin, end))
+            return false;
+    } while (!IsDataLine(begin, end));
+
+    const char* fieldBegin;
+    const char* fieldEnd;
+    NextField(begin, end, fieldBegin, fieldEnd);
+    if (!ParseNumber(fieldBegin, fieldEnd, year))
+        return false;
+
+    values.assign(Scenarios.size(), std::numeric_limits<float>::quiet_NaN());
+    for (size_t column = 0; column < values.size() && begin < end; column++)
+    {
+        double value;
+        NextField(begin, end, fieldBegin, fieldEnd);
+        if (ParseNumber(fieldBegin, fieldEnd, value))
+            values[column] = (float)value;
+    }
+    return true;
+}
+
+void TrajectoryData::LoadWindow(double year)
+{
+    // From the indexed row before the one at or before the year, to two indexed rows after it, so the rows either
+    // side of the year and their neighbours are in the window
+    auto after = std::upper_bound(index.begin(), index.end(), year, [](double value, const IndexEntry& entry) { return value < entry.Year; });
+    size_t entry = after == index.begin() ? 0 : (size_t)(after - index.begin()) - 1;
+    size_t first = entry > 0 ? entry - 1 : 0;
+    size_t rowCount = (std::min(entry + 3, index.size()) - first) * trajectoryIndexInterval;
+
+    windowYears.clear();
+    windowValues.clear();
+    size_t offset = index[first].Offset;
+    double rowYear;
+    while (windowYears.size() < rowCount && ParseRow(offset, rowYear, rowValues))
+    {
+        windowYears.push_back(rowYear);
+        windowValues.insert(windowValues.end(), rowValues.begin(), rowValues.end());
+    }
+    windowAtStart = first == 0;
+    windowAtEnd = windowYears.size() < rowCount || entry + 3 >= index.size();
+}
+
+float TrajectoryData::GetValue(size_t row, int scenario) const
+{
+    const float* values = windowValues.data() + row * Scenarios.size();
+    return std::isnan(values[scenario]) ? values[0] : values[scenario];
+}
+
+bool TrajectoryData::Sample(int scenario, double year, float& ppm)
+{
+    if (scenario < 0 || scenario >= (int)Scenarios.size() || index.empty())
+        return false;
+    year = std::clamp(year, FirstYear, LastYear);
+
+    // Parse again only when the rows around the year are not both in the window with a neighbour each
+    auto isInWindow = [this](double value)
+    {
+        size_t rows = windowYears.size();
+        return rows >= 2 && (windowAtStart ? value >= windowYears.front() : rows >= 3 && value >= windowYears[1]) &&
+               (windowAtEnd ? value <= windowYears.back() : rows >= 3 && value < windowYears[rows - 2]);
+    };
+    if (!isInWindow(year))
+        LoadWindow(year);
+    size_t rows = windowYears.size();
+    if (rows == 0)
+        return false;
+    if (rows == 1)
+    {
+        ppm = GetValue(0, scenario);
+        return !std::isnan(ppm);
+    }
+
+    size_t row = (size_t)(std::upper_bound(windowYears.begin(), windowYears.end(), year) - windowYears.begin());
+    row = std::clamp(row, (size_t)1, rows - 1) - 1;
+    double year0 = windowYears[row];
+    double year1 = windowYears[row + 1];
+    float value0 = GetValue(row, scenario);
+    float value1 = GetValue(row + 1, scenario);
+    if (year == year0 && !std::isnan(value0))
+    {
+        ppm = value0;
+        return true;
+    }
+    if (std::isnan(value0) || std::isnan(value1))
+        return false;
+    if (year1 <= year0)
+    {
+        ppm = value1;
+        return true;
+    }
+
+    // Cubic Hermite between the two rows. The slope at a row is the mean of the slopes either side, but zero at a
+    // peak or trough and no steeper than three times either side, so the curve is smooth and never overshoots.
+    float secant = (float)((value1 - value0) / (year1 - year0));
+    auto slope = [this, scenario, rows, secant](size_t at, size_t neighbour, bool before)
+    {
+        if (neighbour >= rows)
+            return secant;
+        float value = GetValue(neighbour, scenario);
+        double span = before ? windowYears[at] - windowYears[neighbour] : windowYears[neighbour] - windowYears[at];
+        if (std::isnan(value) || span <= 0)
+            return secant;
+        float outer = (float)((before ? GetValue(at, scenario) - value : value - GetValue(at, scenario)) / span);
+        if (outer * secant <= 0)
+            return 0.0f;
+        float mean = 0.5f * (outer + secant);
+        float limit = 3 * std::min(std::fabs(outer), std::fabs(secant));
+        return std::clamp(mean, -limit, limit);
+    };
+    float slope0 = row > 0 ? slope(row, row - 1, true) : secant;
+    float slope1 = slope(row + 1, row + 2, false);
+
+    float span = (float)(year1 - year0);
+    float t = (float)((year - year0) / (year1 - year0));
+    float t2 = t * t;
+    float t3 = t2 * t;
+    ppm = (2 * t3 - 3 * t2 + 1) * value0 + (t3 - 2 * t2 + t) * span * slope0 + (-2 * t3 + 3 * t2) * value1 + (t3 - t2) * span * slope1;
+    return true;
+}
+
+bool TrajectoryPlayer::Start(const std::string& fileName, const std::string& scenarioToPlay, std::string& error)
+{
+    playing = false;
+    if (!data.Open(fileName, error))
+        return false;
+
+    scenario = data.FindScenario(scenarioToPlay);
+    if (scenario < 0)
+    {
+        error = fileName + " has no scenario " + scenarioToPlay;
+        return false;
+    }
+    scenarioName = scenarioToPlay;
+    year = data.FirstYear;
+    playing = true;
+    return true;
+}
+
+void TrajectoryPlayer::Stop()
+{
+    playing = false;
+}
+
+void TrajectoryPlayer::Seek(double toYear)
+{
+    year = std::clamp(toYear, data.FirstYear, data.LastYear);
+}
+
+bool TrajectoryPlayer::Update(float seconds, float& level)
+{
+    if (!playing)
+        return false;
+
+    if (!Paused)
+        Seek(year + (double)seconds * YearsPerSecond);
+
+    // The playback ends where the scenario's values do
+    float ppm;
+    if (!data.Sample(scenario, year, ppm))
+    {
+        playing = false;
+        return false;
+    }
+    level = GetCarbonDioxideLevelForPpm(ppm);
+    return true;
+}
+
+float GetCarbonDioxideLevelForPpm(float ppm)
+{
+    const VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    float todayLevel = control.Min + 0.4f * control.GetRange();
+    for (const Scenario& scenario : scenarios)
+    {
+        if (std::strcmp(scenario.Name, "Today") == 0)
+            todayLevel = scenario.CarbonDioxideLevel;
+    }
+    return control.Min + (ppm - preIndustrialPpm) * (todayLevel - control.Min) / (todayPpm - preIndustrialPpm);
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A read-only file mapped into memory, so it can be parsed in place however large it is
+struct MappedFile
+{
+    bool Open(const std::string& fileName);
+    void Close();
+
+    const char* GetData() const
+    {
+        return data;
+    }
+
+    size_t GetSize() const
+    {
+        return size;
+    }
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+// Rows of every this many are indexed by year when a trajectory is opened; a seek parses at most a few of these
+const int trajectoryIndexInterval = 64;
+
+// Carbon dioxide over the years from a CSV file: a "year" column followed by one column per scenario, in ppm, with
+// the rows in order of year. The first column is the measured history; where a scenario has no value (before its
+// projection starts) the history stands in for it. Lines starting with # are comments.
+//
+// The file stays mapped and is never read as a whole: opening it only finds the rows to index, and the rows around
+// the year asked for are parsed into a small window, which is parsed again only once the year moves out of it.
+struct TrajectoryData
+{
+    std::vector<std::string> Scenarios;
+    double FirstYear = 0;
+    double LastYear = 0;
+
+    bool Open(const std::string& fileName, std::string& error);
+
+    // Column of the scenario with this name, or -1
+    int FindScenario(const std::string& name) const;
+
+    // Carbon dioxide in ppm in the given scenario, smoothly interpolated between the rows without overshooting them;
+    // false if the scenario has no value around that year
+    bool Sample(int scenario, double year, float& ppm);
+
+private:
+    struct IndexEntry
+    {
+        double Year;
+        size_t Offset;
+    };
+
+    // Parse one row from the offset; false at the end of the file
+    bool ParseRow(size_t& offset, double& year, std::vector<float>& values) const;
+    void LoadWindow(double year);
+    float GetValue(size_t row, int scenario) const;
+
+    MappedFile file;
+    std::vector<IndexEntry> index;
+
+    // Parsed rows: their years, and the values row by row, NaN where a value is missing
+    std::vector<double> windowYears;
+    std::vector<float> windowValues;
+    bool windowAtStart = false;
+    bool windowAtEnd = false;
+    std::vector<float> rowValues;
+};
+
+// Plays a scenario of a trajectory back at a number of years per second of real time
+struct TrajectoryPlayer
+{
+    // Defaults to 1950 to 2100 in a minute
+    float YearsPerSecond = 2.5f;
+    bool Paused = false;
+
+    bool Start(const std::string& fileName, const std::string& scenario, std::string& error);
+    void Stop();
+
+    bool IsPlaying() const
+    {
+        return playing;
+    }
+
+    // Jump to a year, within the trajectory
+    void Seek(double year);
+
+    double GetYear() const
+    {
+        return year;
+    }
+
+    const std::string& GetScenarioName() const
+    {
+        return scenarioName;
+    }
+
+    // Advance by the time since the last frame and give the carbon dioxide level to set; false if there is none
+    bool Update(float seconds, float& level);
+
+private:
+    TrajectoryData data;
+    int scenario = -1;
+    std::string scenarioName;
+    double year = 0;
+    bool playing = false;
+};
+
+// Carbon dioxide level of the control species for a concentration in ppm: pre-industrial air is its Min, and today's
+// air is the "Today" scenario
+float GetCarbonDioxideLevelForPpm(float ppm);
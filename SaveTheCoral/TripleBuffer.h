@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+
+// Hands values from one writer thread to one reader thread without either ever blocking: the writer always has a
+// buffer to fill, the reader always has the newest complete one to read, and the third buffer sits in between.
+template <typename T>
+struct TripleBuffer
+{
+    // Writer side: fill this buffer, then publish it
+    T& GetWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    // Returns false if the previously published buffer was replaced before the reader got to it
+    bool Publish()
+    {
+        int previous = shared.exchange(writeIndex | freshBit);
+        writeIndex = previous & indexMask;
+        return (previous & freshBit) == 0;
+    }
+
+    // Reader side: switch to the newest published buffer; returns false if nothing new was published since the last call
+    bool Acquire()
+    {
+        if ((shared.load() & freshBit) == 0)
+            return false;
+
+        int previous = shared.exchange(readIndex);
+        readIndex = previous & indexMask;
+        return true;
+    }
+
+    const T& GetReadBuffer() const
+    {
+        return buffers[readIndex];
+    }
+
+private:
+    static const int indexMask = 3;
+    static const int freshBit = 4;
+
+    T buffers[3];
+    std::atomic<int> shared{ 1 };
+    int writeIndex = 0;
+    int readIndex = 2;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Little-endian base-128 integers, 7 bits per byte with the top bit set on all but the last byte
+inline void WriteVarint(std::vector<uint8_t>& bytes, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t)value);
+}
+
+inline bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7)
+    {
+        uint8_t byte = *data++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Small deltas of either sign become small unsigned numbers: 0, -1, 1, -2, 2... map to 0, 1, 2, 3, 4...
+inline uint32_t ZigZag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t UnZigZag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+inline void WriteFloat(std::vector<uint8_t>& bytes, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 4; i++)
+        bytes.push_back((uint8_t)(bits >> (i * 8)));
+}
+
+inline bool ReadFloat(const uint8_t*& data, const uint8_t* end, float& value)
+{
+    if (end - data < 4)
+        return false;
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; i++)
+        bits |= (uint32_t)*data++ << (i * 8);
+    std::memcpy(&value, &bits, sizeof(value));
+    return true;
+}
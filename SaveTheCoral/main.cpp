@@ -3,21 +3,48 @@
 #include <cmath>
 #include <algorithm>
 #include <ctime>
+#include <vector>
+#include <string>
 #include <cstdlib>
-#include <Windows.h>
-
-#define MAX_SHAPES 1000
-
-// Define some constants
-const float windowWidth = 2000;
-const float windowHeight = 1400;
-const float menuHeight = 220;
+#include <cctype>
+#include <thread>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include "Benchmark.h"
+#include "DisplaySync.h"
+#include "FrameGovernor.h"
+#include "JobSystem.h"
+#include "LevelHistory.h"
+#include "Profiler.h"
+#include "ReefMask.h"
+#include "RemoteControl.h"
+#include "SessionLog.h"
+#include "Simulation.h"
+#include "SimulationThread.h"
+#include "SnapshotCodec.h"
+#include "Telemetry.h"
+#include "TextBatch.h"
+#include "TimeSeries.h"
+#include "Trajectory.h"
 
 // Window
 sf::RenderWindow window;
+bool fullscreen = false;
+int fullscreenModeIndex = 0;
+
+// The logical layout is letterboxed into the window through this view
+sf::View sceneView(sf::FloatRect(0.0f, 0.0f, windowWidth, windowHeight));
 
-// Screen areas
-sf::Rect<float> reefRect(0.0f, menuHeight, windowWidth, windowHeight - menuHeight);
+// When frames take longer than the budget, the scene is rendered at a lower internal resolution and upscaled
+sf::RenderTexture sceneTexture;
+sf::Sprite sceneSprite;
+
+// Adjusts render scale, molecule count and molecule detail to keep the frame rate on target
+FrameGovernor frameGovernor;
+float targetFps = 60;
+float batteryTargetFps = 30;
 
 // Sounds
 sf::SoundBuffer backgroundSoundBuffer;
@@ -29,189 +56,638 @@ sf::Sound wavesSound;
 sf::Texture reefTexture;
 sf::Sprite reefSprite;
 sf::Shader reefShader;
+sf::Image reefImage;
+
+// The bleached reef is rendered once into a cache and only re-rendered when the coral health changes
+sf::RenderTexture reefCache;
+sf::Sprite reefCacheSprite;
+uint64_t reefCacheHealthVersion = 0;
+float reefCacheGrayScale = -1;
+
+// Coral health over the reef, one texel per health cell, which the reef shader samples for the amount of bleaching.
+// SFML only has RGBA textures, the health is in the red channel.
+sf::Texture healthTexture;
+std::vector<sf::Uint8> healthPixels;
+
+// The water temperature as a heatmap over the reef, one texel per temperature cell, toggled with T
+bool showTemperature = false;
+sf::Texture temperatureTexture;
+sf::Sprite temperatureSprite;
+std::vector<sf::Uint8> temperaturePixels;
+uint64_t temperatureUploadedVersion = 0;
+const sf::Uint8 temperatureOpacity = 110;
+
+// The coral grid is drawn over the reef from a texture with one pixel per cell; only changed tiles are uploaded
+sf::Texture coralTexture;
+sf::Sprite coralSprite;
+std::vector<uint64_t> coralUploadedVersions;
+std::vector<sf::Uint8> coralTilePixels;
+
+// Bleach through a 3D colour lookup table (unwrapped into a 2D strip of blue slices) instead of the hand-tuned shader math
+bool useBleachingLut = true;
+const unsigned int bleachingLutSize = 16;
+sf::Texture bleachingLut;
+
+// How far fully bleached coral moves from gray towards white
+const float bleachedPaleness = 0.45f;
+
+// Load and downsample the reef image on a worker thread while the rest of the resources load
+bool downsampleReefOnWorker = true;
+
+// The simulation runs on its own thread; the renderer only ever reads its snapshots
+SimulationThread simulationThread;
+const float simulationStepRate = 60;
+
+// Sessions can be recorded and replayed exactly, since the simulation only depends on the seed and the commands
+uint32_t sessionSeed = 0;
+SessionRecorder sessionRecorder;
+std::string recordFileName;
+SessionPlayer sessionPlayer;
+std::string replayFileName;
+float replaySpeed = 1;
+
+// Optionally the carbon dioxide follows the history and a projection over the years instead of the keys; Space pauses,
+// Page Up and Page Down skip ten years, Home starts over, + and - change the speed and the arrow keys take over by hand
+TrajectoryPlayer trajectoryPlayer;
+std::string trajectoryFileName = "resources/co2_trajectory.csv";
+std::string trajectoryScenario;
+const double trajectorySeekYears = 10;
+const float trajectorySpeedFactor = 1.5f;
+
+// Optional ensemble of perturbed chemistry, shown as bands on the legend sliders and toggled with E
+ChemistryEnsemble chemistryEnsemble;
+int ensembleMembers = 0;
+bool showEnsemble = true;
+
+// Chart of every species' level over the last minute up to the last week, toggled with H; Z changes how far back it
+// goes. Each species gets a lane with one line per column from the lowest to the highest level in that column's steps.
+LevelHistory levelHistory;
+bool showHistory = false;
+const float historySpanSeconds[] = { 60, 600, 3600, 86400, 604800 };
+const char* historySpanNames[] = { "Last minute", "Last 10 minutes", "Last hour", "Last day", "Last week" };
+const int historySpanCount = 5;
+int historySpan = 1;
+const int historyColumns = 200;
+const sf::FloatRect historyRect(20, windowHeight - 320, 800, 300);
+const float historyNameWidth = 160;
+sf::VertexArray historyBatch(sf::Lines);
+std::vector<float> speciesLevels;
+std::vector<float> historyMins;
+std::vector<float> historyMaxs;
+
+// Optional log of every step's species levels for analysis afterwards
+TimeSeriesWriter levelLog;
+std::string levelLogFileName;
+
+// Optional telemetry stream for external dashboards
+TelemetryServer telemetryServer;
+unsigned short telemetryPort = 0;
+float telemetryRate = 10;
+
+// Optional remote control over UDP, and the frame time benchmark it can trigger
+RemoteControl remoteControl;
+unsigned short controlPort = 0;
+FrameTimeRecorder frameTimeRecorder;
+
+// Several instances can show one simulation across displays: the leader runs it and each follower shows a column of the reef
+DisplayLeader displayLeader;
+std::string leaderDestinations;
+DisplayFollower displayFollower;
+unsigned short followerPort = 0;
+int reefColumn = 0;
+int reefColumns = 1;
+sf::FloatRect reefVisibleRect;
+
+// Species, chemistry and menu layout come from a file that is reloaded when it changes
+std::string speciesConfigFileName = "resources/species.cfg";
+std::filesystem::file_time_type speciesConfigTime;
+sf::Clock speciesConfigCheckClock;
+
+// Debugging overlay, toggled with F3
+Profiler profiler;
 
 // Universal shape properties
 float shapeOutlineThickness = 3;
 sf::Color shapeOutlineColor(100, 100, 100);
 
+// Every molecule is a quad textured from an atlas holding one pre-rendered circle per species, so all of them draw in one call
+const int moleculeAtlasCellSize = 32;
+sf::RenderTexture moleculeAtlas;
+sf::VertexArray moleculeBatch(sf::Quads);
+
+// Fish as small triangles pointing where they swim and plankton as specks, all in one batch
+sf::VertexArray faunaBatch(sf::Triangles);
+float moleculeOutlineThickness = 3;
+
 // Font and text color
 sf::Font font;
 sf::Color textColor(sf::Color::Black);
 
-// Text elements
-sf::Text textMenuTitle;
-sf::Text textMenuCarbonDioxide;
+// All static text (menu and legend names) is batched and drawn in one go
+TextBatch staticText;
+const float legendFontSize = 20;
+
+void DrawLegend(sf::RenderTarget& target, const SpeciesConfig::LegendLayout& entry, float level, const EnsembleBand* band)
+{
+    const VariableData& data = *allSpecies[entry.Species];
+    float fontSize = legendFontSize;
+    float x = entry.Position.x;
+    float y = entry.Position.y;
+
+    if (entry.SampleShape)
+    {
+        sf::CircleShape indicator;
+        indicator.setPosition(x + (fontSize - data.Size) / 2.0f, y + (fontSize - data.Size) / 2.0f);
+        indicator.setFillColor(data.Color);
+        indicator.setRadius(data.Size);
+        indicator.setOutlineThickness(shapeOutlineThickness);
+        indicator.setOutlineColor(shapeOutlineColor);
+        target.draw(indicator);
+    }
+
+    float sliderOffset = 250;
+    float sliderRange = 200;
+    float margin = 3;
+
+    sf::RectangleShape bar;
+    bar.setFillColor(data.Color);
+    bar.setOutlineColor(sf::Color::Black);
+    bar.setOutlineThickness(1.0f);
+    bar.setSize(sf::Vector2f(sliderRange + (margin * 2), fontSize));
+    bar.setPosition(x + sliderOffset, y);
+    target.draw(bar);
+
+    // The ensemble's spread: the middle half brighter than the rest, and its median
+    if (band)
+    {
+        auto toSlider = [&](float value) { return x + sliderOffset + margin + sliderRange * std::clamp((value - data.Min) / (data.Max - data.Min), 0.0f, 1.0f); };
+        sf::RectangleShape range;
+        range.setFillColor(sf::Color(255, 255, 255, 90));
+        range.setPosition(toSlider(band->Low), y + 4);
+        range.setSize(sf::Vector2f(toSlider(band->High) - toSlider(band->Low), fontSize - 8));
+        target.draw(range);
+        range.setFillColor(sf::Color(255, 255, 255, 160));
+        range.setPosition(toSlider(band->LowerQuartile), y + 2);
+        range.setSize(sf::Vector2f(toSlider(band->UpperQuartile) - toSlider(band->LowerQuartile), fontSize - 4));
+        target.draw(range);
+        range.setFillColor(sf::Color::Black);
+        range.setPosition(toSlider(band->Median) - 1, y);
+        range.setSize(sf::Vector2f(2.0f, fontSize));
+        target.draw(range);
+    }
+
+    bar.setSize(sf::Vector2f(3.0f, fontSize));
+
+    bar.setFillColor(sf::Color::Green);
+    bar.setOutlineColor(sf::Color(50, 50, 50));
+    bar.setOutlineThickness(3);
+    int indicatorOffset = (int) ( sliderRange * ( (level - data.Min) /  (data.Max - data.Min)));
+    bar.setPosition(x + sliderOffset + margin + indicatorOffset, y);
+    target.draw(bar);
+}
+
+// Render one molecule of every species into the atlas; fewer points per circle and no outlines at the lower levels of detail
+void CreateMoleculeAtlas(int detailLevel)
+{
+    static const size_t pointCounts[] = { 30, 12, 8 };
+    moleculeOutlineThickness = detailLevel < 2 ? shapeOutlineThickness : 0;
+
+    if (moleculeAtlas.getSize().x != moleculeAtlasCellSize * allSpecies.size())
+        moleculeAtlas.create(moleculeAtlasCellSize * (unsigned int)allSpecies.size(), moleculeAtlasCellSize);
+
+    moleculeAtlas.clear(sf::Color::Transparent);
+    for (size_t s = 0; s < allSpecies.size(); s++)
+    {
+        sf::CircleShape shape(allSpecies[s]->Size, pointCounts[detailLevel]);
+        shape.setPosition(s * moleculeAtlasCellSize + 1 + moleculeOutlineThickness, 1 + moleculeOutlineThickness);
+        shape.setFillColor(allSpecies[s]->Color);
+        shape.setOutlineThickness(moleculeOutlineThickness);
+        shape.setOutlineColor(shapeOutlineColor);
+        moleculeAtlas.draw(shape);
+    }
+    moleculeAtlas.display();
+}
 
-// Define struct to keep track of various simulation data
-struct VariableData
+// Fill the molecule batch from the active molecules of a snapshot, thinned out by the given density
+void BuildMoleculeBatch(const SimulationSnapshot& snapshot, float density)
 {
-    sf::String Name;
-    float Min = 0;
-    float Max = 0;
-    float Level = 0;
-    float Size = 0;
-    int Speed = 0;
-    sf::Color Color = sf::Color::Black;
-    sf::CircleShape Shapes[MAX_SHAPES];
+    size_t vertexCount = 0;
+    for (size_t s = 0; s < snapshot.Species.size() && s < allSpecies.size(); s++)
+        vertexCount += (size_t)std::ceil(snapshot.Species[s].X.size() * density) * 4;
+    moleculeBatch.resize(vertexCount);
 
-    void Initialize(const sf::String name, float min, float max, sf::Color color, float size, int speed)
+    // A follower may get more species from its leader than it has itself; those are not shown
+    size_t v = 0;
+    for (size_t s = 0; s < snapshot.Species.size() && s < allSpecies.size(); s++)
     {
-        Name = name;
-        Min = min;
-        Max = max;
-        Color = color;
-        Size = size;
-        Speed = speed;
+        const VariableData& data = *allSpecies[s];
+        const SimulationSnapshot::SpeciesState& species = snapshot.Species[s];
+        int count = (int)std::ceil(species.X.size() * density);
+        float extent = (data.Size + moleculeOutlineThickness) * 2;
+        float u = s * moleculeAtlasCellSize + 1.0f;
+        float v0 = 1.0f;
+        const float* x = species.X.data();
+        const float* y = species.Y.data();
 
-        // Initialize shapes
-        for (int i = 0; i < MAX_SHAPES; i++)
+        for (int i = 0; i < count; i++)
         {
-            float x = reefRect.left + std::rand() % (int)reefRect.width;
-            float y = reefRect.top + std::rand() % (int)reefRect.height;
-            Shapes[i].setPosition(x, y);
-            Shapes[i].setFillColor(Color);
-            Shapes[i].setRadius(size);
-            Shapes[i].setOutlineThickness(shapeOutlineThickness);
-            Shapes[i].setOutlineColor(shapeOutlineColor);
+            // The shape's position is the top-left of its fill circle, the outline extends outside of it
+            float left = x[i] - moleculeOutlineThickness;
+            float top = y[i] - moleculeOutlineThickness;
+            moleculeBatch[v++] = sf::Vertex(sf::Vector2f(left, top), sf::Vector2f(u, v0));
+            moleculeBatch[v++] = sf::Vertex(sf::Vector2f(left + extent, top), sf::Vector2f(u + extent, v0));
+            moleculeBatch[v++] = sf::Vertex(sf::Vector2f(left + extent, top + extent), sf::Vector2f(u + extent, v0 + extent));
+            moleculeBatch[v++] = sf::Vertex(sf::Vector2f(left, top + extent), sf::Vector2f(u, v0 + extent));
         }
     }
+}
 
-    float GetRange()
+// Fill the fauna batch from the animals of a snapshot; unhealthy animals fade to gray
+void BuildFaunaBatch(const FaunaState& fauna)
+{
+    faunaBatch.resize(fauna.X.size() * 3);
+    for (size_t i = 0; i < fauna.X.size(); i++)
     {
-        return Max - Min;
+        float health = fauna.Health[i];
+        sf::Vector2f position(fauna.X[i], fauna.Y[i]);
+        sf::Vertex* triangle = &faunaBatch[i * 3];
+        if (fauna.Kind[i] == FaunaFish)
+        {
+            float speed = std::sqrt(fauna.VelocityX[i] * fauna.VelocityX[i] + fauna.VelocityY[i] * fauna.VelocityY[i]);
+            sf::Vector2f direction = speed > 0 ? sf::Vector2f(fauna.VelocityX[i] / speed, fauna.VelocityY[i] / speed) : sf::Vector2f(1, 0);
+            sf::Vector2f side(-direction.y * 4, direction.x * 4);
+            sf::Color color((sf::Uint8)(200 + 55 * health), (sf::Uint8)(200 - 60 * health), (sf::Uint8)(200 - 160 * health));
+            triangle[0] = sf::Vertex(position + direction * 9.0f, color);
+            triangle[1] = sf::Vertex(position - direction * 6.0f + side, color);
+            triangle[2] = sf::Vertex(position - direction * 6.0f - side, color);
+        }
+        else
+        {
+            sf::Color color(210, 255, 220, (sf::Uint8)(80 + 120 * health));
+            triangle[0] = sf::Vertex(position + sf::Vector2f(0, -2), color);
+            triangle[1] = sf::Vertex(position + sf::Vector2f(2, 1.5f), color);
+            triangle[2] = sf::Vertex(position + sf::Vector2f(-2, 1.5f), color);
+        }
     }
+}
 
-    void DrawShapes()
+// Halve both dimensions of an image by averaging each 2x2 block of pixels
+sf::Image HalveImage(const sf::Image& source)
+{
+    sf::Vector2u sourceSize = source.getSize();
+    unsigned int width = std::max(sourceSize.x / 2, 1u);
+    unsigned int height = std::max(sourceSize.y / 2, 1u);
+    const sf::Uint8* sourcePixels = source.getPixelsPtr();
+
+    std::vector<sf::Uint8> pixels(width * height * 4);
+    for (unsigned int y = 0; y < height; y++)
     {
-        // Only draw up to current Level shapes
-        for (int i = 0; i < Level; i++)
+        unsigned int y0 = std::min(y * 2, sourceSize.y - 1);
+        unsigned int y1 = std::min(y * 2 + 1, sourceSize.y - 1);
+        for (unsigned int x = 0; x < width; x++)
         {
-            sf::Vector2f currentPosition = Shapes[i].getPosition();
+            unsigned int x0 = std::min(x * 2, sourceSize.x - 1);
+            unsigned int x1 = std::min(x * 2 + 1, sourceSize.x - 1);
+            for (unsigned int c = 0; c < 4; c++)
+            {
+                unsigned int sum = sourcePixels[(y0 * sourceSize.x + x0) * 4 + c] + sourcePixels[(y0 * sourceSize.x + x1) * 4 + c] +
+                                   sourcePixels[(y1 * sourceSize.x + x0) * 4 + c] + sourcePixels[(y1 * sourceSize.x + x1) * 4 + c];
+                pixels[(y * width + x) * 4 + c] = (sf::Uint8)((sum + 2) / 4);
+            }
+        }
+    }
 
-            currentPosition.x += (std::rand() % 2 == 0 ? -1 : 1) * (std::rand() % Speed);
-            currentPosition.y += (std::rand() % 2 == 0 ? -1 : 1) * (std::rand() % Speed);
+    sf::Image result;
+    result.create(width, height, pixels.data());
+    return result;
+}
 
-            currentPosition.x = std::min(currentPosition.x, reefRect.left + reefRect.width);
-            currentPosition.y = std::min(currentPosition.y, reefRect.top + reefRect.height);
-            currentPosition.x = std::max(currentPosition.x, reefRect.left);
-            currentPosition.y = std::max(currentPosition.y, reefRect.top);
+// Load the reef image and halve it until it is the smallest resolution tier that still covers the target size
+bool LoadReefImage(const std::string& fileName, sf::Vector2u targetSize)
+{
+    if (!reefImage.loadFromFile(fileName))
+        return false;
 
-            Shapes[i].setPosition(currentPosition);
+    // Never keep a tier larger than the GPU can hold
+    unsigned int maximumSize = sf::Texture::getMaximumSize();
+    sf::Vector2u size = reefImage.getSize();
+    while (size.x > maximumSize || size.y > maximumSize ||
+           (size.x / 2 >= targetSize.x && size.y / 2 >= targetSize.y))
+    {
+        reefImage = HalveImage(reefImage);
+        size = reefImage.getSize();
+    }
 
-            window.draw(Shapes[i]);
-        }
+    return true;
+}
+
+// Build the bleaching lookup table: each entry holds the colour a fully bleached reef pixel of that colour is shifted to
+bool CreateBleachingLut(const std::string& fileName)
+{
+    // An artist-tuned table takes precedence over the built-in one
+    sf::Image lutImage;
+    if (std::ifstream(fileName).good() && lutImage.loadFromFile(fileName) &&
+        lutImage.getSize() == sf::Vector2u(bleachingLutSize * bleachingLutSize, bleachingLutSize))
+    {
+        return bleachingLut.loadFromImage(lutImage);
     }
 
-    float DrawLegend(float x, float y, bool drawSampleShape = true)
+    lutImage.create(bleachingLutSize * bleachingLutSize, bleachingLutSize);
+    for (unsigned int b = 0; b < bleachingLutSize; b++)
     {
-        float fontSize = 20;
-        sf::Text text;
-        text.setFont(font);
-        text.setFillColor(textColor);
-        
-        if (drawSampleShape)
+        for (unsigned int g = 0; g < bleachingLutSize; g++)
         {
-            sf::CircleShape indicator;
-            indicator.setPosition(x + (fontSize - Size) / 2.0f, y + (fontSize - Size) / 2.0f);
-            indicator.setFillColor(Color);
-            indicator.setRadius(Size);
-            indicator.setOutlineThickness(shapeOutlineThickness);
-            indicator.setOutlineColor(shapeOutlineColor);
-            window.draw(indicator);
+            for (unsigned int r = 0; r < bleachingLutSize; r++)
+            {
+                float red = r / (float)(bleachingLutSize - 1);
+                float green = g / (float)(bleachingLutSize - 1);
+                float blue = b / (float)(bleachingLutSize - 1);
+                float grayValue = (red + green + blue) / 3;
+
+                // Same as the reef shader without the table: only coral is bleached, it turns gray and pales
+                sf::Uint8 bleached = (sf::Uint8)std::lround((grayValue + (1 - grayValue) * bleachedPaleness) * 255);
+                lutImage.setPixel(b * bleachingLutSize + r, g, sf::Color(bleached, bleached, bleached));
+            }
         }
+    }
+
+    return bleachingLut.loadFromImage(lutImage);
+}
 
-        int nameOffset = 30;
-        wchar_t buffer[1000];
-        wsprintfW(buffer, L"%s", Name.toWideString().c_str());
-        text.setString(buffer);
-        text.setCharacterSize((int)fontSize);
-        text.setPosition(x + nameOffset, y);
+// Store the coral mask in the alpha channel of the reef image, where the reef shader picks it up with the colour
+void ApplyReefMask(JobSystem& jobs)
+{
+    sf::Vector2u size = reefImage.getSize();
+    std::vector<sf::Uint8> mask;
+    GetReefMask(jobs, reefImage.getPixelsPtr(), size.x, size.y, "cache", mask);
+
+    std::vector<sf::Uint8> pixels(reefImage.getPixelsPtr(), reefImage.getPixelsPtr() + (size_t)size.x * size.y * 4);
+    for (size_t i = 0; i < mask.size(); i++)
+        pixels[i * 4 + 3] = mask[i];
+    reefImage.create(size.x, size.y, pixels.data());
+}
+
+// Upload health values from 0 to 255 into the health texture
+void UploadHealth(int width, int height, const sf::Uint8* values)
+{
+    if (healthTexture.getSize() != sf::Vector2u((unsigned int)width, (unsigned int)height))
+    {
+        healthTexture.create(width, height);
+        healthTexture.setSmooth(true);
+    }
+
+    healthPixels.resize((size_t)width * height * 4);
+    for (int i = 0; i < width * height; i++)
+    {
+        healthPixels[i * 4] = values[i];
+        healthPixels[i * 4 + 1] = values[i];
+        healthPixels[i * 4 + 2] = values[i];
+        healthPixels[i * 4 + 3] = 255;
+    }
+    healthTexture.update(healthPixels.data());
+}
 
-        window.draw(text);
+// Upload the temperature field into the heatmap when it changed, cold water blue through yellow to hot water red
+void UpdateTemperatureTexture(const TemperatureState& temperature)
+{
+    if (temperature.Width == 0 || temperature.Version == temperatureUploadedVersion)
+        return;
 
-        float sliderOffset = 250;
-        float sliderRange = 200;
-        float margin = 3;
+    if (temperatureTexture.getSize() != sf::Vector2u((unsigned int)temperature.Width, (unsigned int)temperature.Height))
+    {
+        temperatureTexture.create(temperature.Width, temperature.Height);
+        temperatureTexture.setSmooth(true);
+        temperatureSprite.setTexture(temperatureTexture, true);
+        temperatureSprite.setPosition(reefRect.left, reefRect.top);
+        temperatureSprite.setScale(reefRect.width / temperature.Width, reefRect.height / temperature.Height);
+    }
 
-        sf::RectangleShape bar;
-        bar.setFillColor(Color);
-        bar.setOutlineColor(sf::Color::Black);
-        bar.setOutlineThickness(1.0f);
-        bar.setSize(sf::Vector2f(sliderRange + (margin * 2), fontSize));
-        bar.setPosition(x + sliderOffset, y);
-        window.draw(bar);
+    temperaturePixels.resize(temperature.Values.size() * 4);
+    for (size_t i = 0; i < temperature.Values.size(); i++)
+    {
+        int value = temperature.Values[i];
+        temperaturePixels[i * 4] = (sf::Uint8)std::min(value * 2, 255);
+        temperaturePixels[i * 4 + 1] = (sf::Uint8)(value < 128 ? value * 2 : (255 - value) * 2);
+        temperaturePixels[i * 4 + 2] = (sf::Uint8)std::max(255 - value * 2, 0);
+        temperaturePixels[i * 4 + 3] = temperatureOpacity;
+    }
+    temperatureTexture.update(temperaturePixels.data());
+    temperatureUploadedVersion = temperature.Version;
+}
 
-        bar.setSize(sf::Vector2f(3.0f, fontSize));
+// Re-render the bleached reef into the cache, but only if the coral health changed since the last time. Without a
+// health field (a display follower only gets the levels) the whole reef bleaches by the gray scale instead.
+void UpdateReefCache(const CoralHealthState& health, float grayScale)
+{
+    if (health.Width > 0)
+    {
+        if (health.Version == reefCacheHealthVersion)
+            return;
 
-        bar.setFillColor(sf::Color::Green);
-        bar.setOutlineColor(sf::Color(50, 50, 50));
-        bar.setOutlineThickness(3);
-        int indicatorOffset = (int) ( sliderRange * ( (Level - Min) /  (Max - Min)));
-        bar.setPosition(x + sliderOffset + margin + indicatorOffset, y);
-        window.draw(bar);
+        UploadHealth(health.Width, health.Height, health.Values.data());
+        reefCacheHealthVersion = health.Version;
+        reefCacheGrayScale = -1;
+    }
+    else
+    {
+        if (grayScale == reefCacheGrayScale)
+            return;
 
-        return y + fontSize + 10;
+        sf::Uint8 value = (sf::Uint8)std::lround((1 - std::clamp(grayScale, 0.0f, 1.0f)) * 255);
+        UploadHealth(1, 1, &value);
+        reefCacheGrayScale = grayScale;
+        reefCacheHealthVersion = 0;
     }
-} carbonDioxide, carbonicAcid, carbonate, biCarbonate, calciumCarbonate, phLevel, waterTemperature;
 
-void AdjustCarbonDioxide(int amount)
+    sf::RenderStates states(&reefShader);
+    states.transform.translate(-reefRect.left, -reefRect.top);
+
+    reefShader.setUniform("alphaIsMask", 1.0f);
+    reefCache.clear(sf::Color::White);
+    reefCache.draw(reefSprite, states);
+    reefCache.display();
+    reefShader.setUniform("alphaIsMask", 0.0f);
+}
+
+// Letterbox the logical layout into the window and size the internal render target to match
+void UpdateView()
 {
-    // This is what the user can change
-    carbonDioxide.Level = std::clamp(carbonDioxide.Level + amount, carbonDioxide.Min, carbonDioxide.Max);
+    sf::Vector2u size = window.getSize();
+    float scale = std::min(size.x / windowWidth, size.y / windowHeight);
+    float width = windowWidth * scale / size.x;
+    float height = windowHeight * scale / size.y;
+    sceneView.setViewport(sf::FloatRect((1 - width) / 2, (1 - height) / 2, width, height));
+    window.setView(sceneView);
 
-    float polutionFactor = (carbonDioxide.Level - carbonDioxide.Min) / carbonDioxide.GetRange();
+    sceneTexture.create(std::max((unsigned int)(windowWidth * scale), 1u), std::max((unsigned int)(windowHeight * scale), 1u));
+    sceneTexture.setSmooth(true);
+    sceneSprite.setTexture(sceneTexture.getTexture(), true);
+}
 
-    // As carbon dioxide increases, so does carbonic acid, which is produced when carbon dioxide reacts with water
-    carbonicAcid.Level = carbonicAcid.Min + carbonicAcid.GetRange() * polutionFactor;
+// Create the window, either fullscreen in one of the supported modes or windowed to fit on the desktop
+void OpenWindow()
+{
+    const std::vector<sf::VideoMode>& modes = sf::VideoMode::getFullscreenModes();
+    if (fullscreen && !modes.empty())
+    {
+        sf::VideoMode mode = modes[std::clamp(fullscreenModeIndex, 0, (int)modes.size() - 1)];
+        window.create(mode, "Sample graphics", sf::Style::Fullscreen);
+    }
+    else
+    {
+        sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+        float scale = std::min({ 1.0f, desktop.width * 0.9f / windowWidth, desktop.height * 0.9f / windowHeight });
+        window.create(sf::VideoMode((int)(windowWidth * scale), (int)(windowHeight * scale), 32), "Sample graphics", sf::Style::Default);
+    }
+    window.setVerticalSyncEnabled(true);
 
-    // As carbonic acid levels go up, they react with carbonate in the water, therefore carbonate levels go down
-    carbonate.Level = carbonate.Max - (carbonate.GetRange() * polutionFactor);
+    UpdateView();
+}
+
+// Bring the coral texture up to date with the snapshot's grid; returns the number of tiles uploaded
+int UpdateCoralTexture(const CoralState& coral)
+{
+    if (coral.Width == 0)
+        return 0;
 
-    // As carbonic acid levels go up, so do bi-carbonate levels which is produced when carbonic acid reacts with carbonate
-    biCarbonate.Level = biCarbonate.Min + (biCarbonate.GetRange() * polutionFactor);
+    if (coralTexture.getSize() != sf::Vector2u((unsigned int)coral.Width, (unsigned int)coral.Height))
+    {
+        coralTexture.create(coral.Width, coral.Height);
+        coralTexture.setSmooth(true);
+        coralSprite.setTexture(coralTexture, true);
+        coralSprite.setPosition(reefRect.left, reefRect.top);
+        coralSprite.setScale((float)coralCellSize, (float)coralCellSize);
+        coralUploadedVersions.assign(coral.TileVersions.size(), 0);
+    }
 
-    // As carbonate levels drop, there will be less carbonate to form calcium carbonate by the corals, therefore calcium carbonate levels also go down
-    calciumCarbonate.Level = calciumCarbonate.Max - (calciumCarbonate.GetRange() * polutionFactor);
+    int uploaded = 0;
+    coralTilePixels.resize(coralTileSize * coralTileSize * 4);
+    for (int tileY = 0; tileY < coral.TilesY; tileY++)
+    {
+        for (int tileX = 0; tileX < coral.TilesX; tileX++)
+        {
+            int tile = tileY * coral.TilesX + tileX;
+            if (coralUploadedVersions[tile] == coral.TileVersions[tile])
+                continue;
 
-    // Water gets more acidic (pH goes down) as the level of carbon dioxide goes up
-    phLevel.Level = phLevel.Max - (phLevel.GetRange() * polutionFactor);
+            int left = tileX * coralTileSize;
+            int top = tileY * coralTileSize;
+            int width = std::min(coralTileSize, coral.Width - left);
+            int height = std::min(coralTileSize, coral.Height - top);
+            sf::Uint8* pixel = coralTilePixels.data();
+            for (int y = top; y < top + height; y++)
+            {
+                for (int x = left; x < left + width; x++)
+                {
+                    // Young coral is pale and see-through, grown coral a deep, solid coral red
+                    int density = coral.Cells[y * coral.Width + x];
+                    *pixel++ = (sf::Uint8)(255 - density / 8);
+                    *pixel++ = (sf::Uint8)(190 - density / 3);
+                    *pixel++ = (sf::Uint8)(160 - density / 3);
+                    *pixel++ = (sf::Uint8)std::min(density * 2, 230);
+                }
+            }
 
-    // Due to global warming caused by CO2, the water temperature increases
-    waterTemperature.Level = waterTemperature.Min + (phLevel.GetRange() * polutionFactor);
+            coralTexture.update(coralTilePixels.data(), width, height, left, top);
+            coralUploadedVersions[tile] = coral.TileVersions[tile];
+            uploaded++;
+        }
+    }
+    return uploaded;
 }
 
-int SetText(sf::Text& text, int fontSize, int x, int y, const sf::String textString)
+// Load the species configuration the simulation is created from
+bool LoadSpeciesConfigFile()
 {
-    text.setFont(font);
-    text.setFillColor(textColor);
+    std::string error;
+    if (!LoadSpeciesConfig(speciesConfigFileName, speciesConfig, error))
+    {
+        std::cout << error << std::endl;
+        return false;
+    }
 
-    text.setString(textString);
-    text.setCharacterSize(fontSize);
-    text.setPosition((float)x, (float)y);
+    std::error_code ignored;
+    speciesConfigTime = std::filesystem::last_write_time(speciesConfigFileName, ignored);
+    return true;
+}
+
+// Batch the menu text and the legend names as laid out in the species configuration
+void LayOutText()
+{
+    staticText.Clear();
+    for (const SpeciesConfig::TextLayout& text : speciesConfig.Texts)
+        staticText.Add(sf::String::fromUtf8(text.String.begin(), text.String.end()), text.Size, text.Position, textColor);
 
-    return y + fontSize + 10;
+    int nameOffset = 30;
+    for (const SpeciesConfig::LegendLayout& entry : speciesConfig.Legend)
+        staticText.Add(allSpecies[entry.Species]->Name, (unsigned int)legendFontSize, entry.Position + sf::Vector2f((float)nameOffset, 0), textColor);
 }
 
-void Initialize()
+// Check about once a second whether the configuration file changed, and if so switch the running simulation over
+void ReloadSpeciesConfigIfChanged(JobSystem& jobs, float stepRate, bool simulating)
 {
-    std::srand(GetTickCount());
+    if (speciesConfigCheckClock.getElapsedTime().asSeconds() < 1.0f)
+        return;
+    speciesConfigCheckClock.restart();
+
+    std::error_code error;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(speciesConfigFileName, error);
+    if (error || time == speciesConfigTime)
+        return;
+    speciesConfigTime = time;
+
+    // A recorded or replayed session has to run with the configuration it started with
+    if (simulationThread.Recorder || simulationThread.Player)
+    {
+        std::cout << "Not reloading " << speciesConfigFileName << " while a session is recorded or replayed" << std::endl;
+        return;
+    }
+
+    // A broken file leaves the current configuration running
+    SpeciesConfig config;
+    std::string problem;
+    if (!LoadSpeciesConfig(speciesConfigFileName, config, problem))
+    {
+        std::cout << problem << std::endl;
+        return;
+    }
 
-    carbonDioxide.Initialize("Carbon Dioxide", 100, 200, sf::Color::Red, 5, 3);
-    carbonicAcid.Initialize("Carbonic Acid", 100, 400, sf::Color(255, 165, 0), 8, 2);
-    carbonate.Initialize("Carbonate", 20, 300, sf::Color::Green, 5, 3);
-    biCarbonate.Initialize("Bi-Carbonate", 10, 200, sf::Color(25, 25, 112), 7, 2);
-    calciumCarbonate.Initialize("Calcium Carbonate", 10, 200, sf::Color(255, 248, 220), 10, 2);
-    phLevel.Initialize("pH Level", 0, 10, sf::Color::White, 10, 2);
-    waterTemperature.Initialize("Water temperature", 0, 10, sf::Color::White, 10, 2);
+    if (simulating)
+        simulationThread.Stop();
+    ApplySpeciesConfig(config);
+    if (simulating)
+        simulationThread.Start(jobs, stepRate);
 
-    AdjustCarbonDioxide(0);
+    CreateMoleculeAtlas(frameGovernor.DetailLevel);
+    LayOutText();
+    telemetryServer.SendHeader();
+    std::cout << "Reloaded " << speciesConfigFileName << ": " << config.Species.size() << " species" << std::endl;
+}
+
+void Initialize(JobSystem& jobs)
+{
+    InitializeSimulation(sessionSeed);
 
     // Create the window of the application
-    window.create(sf::VideoMode((int)windowWidth, (int)windowHeight, 32), "Sample graphics", sf::Style::Titlebar | sf::Style::Close);
-    window.setVerticalSyncEnabled(true);
+    OpenWindow();
 
-    // Load the font
+    // Start loading the reef image at the resolution the reef area actually covers on screen
+    sf::Vector2u sceneSize = sceneTexture.getSize();
+    sf::Vector2u reefTargetSize((unsigned int)(reefRect.width * sceneSize.x / windowWidth), (unsigned int)(reefRect.height * sceneSize.y / windowHeight));
+    std::thread reefLoader;
+    if (downsampleReefOnWorker)
+        reefLoader = std::thread(LoadReefImage, "resources/reef.jpg", reefTargetSize);
+    else
+        LoadReefImage("resources/reef.jpg", reefTargetSize);
+
+    // Load the font and rasterize the glyphs the UI uses in the background, so the first frames do not hitch
     font.loadFromFile("resources/sansation.ttf");
+    sf::String glyphSet;
+    for (sf::Uint32 character = ' '; character <= '~'; character++)
+        glyphSet += character;
+    // The batched text and legend are at 20 and 40, the history chart at 16 and the profiler at 18; the trajectory
+    // caption is outlined
+    std::thread glyphLoader(PrewarmGlyphs, std::cref(font), glyphSet, std::vector<unsigned int>{ 16, 18, 20, 40 }, std::vector<float>{ 0, 2 });
 
     // Load the sounds
     backgroundSoundBuffer.loadFromFile("resources/underwaterpool.wav");
@@ -225,8 +701,13 @@ void Initialize()
     wavesSound.setLoop(true);
     wavesSound.play();
 
-    // Load images
-    reefTexture.loadFromFile("resources/reef.jpg");
+    // Upload the reef image once the loader is done, with mipmaps so that it is never undersampled when scaled down
+    if (reefLoader.joinable())
+        reefLoader.join();
+    glyphLoader.join();
+    ApplyReefMask(jobs);
+    reefTexture.loadFromImage(reefImage);
+    reefTexture.generateMipmap();
     reefTexture.setSmooth(true);
 
     // Initialize reef sprite
@@ -237,38 +718,530 @@ void Initialize()
     reefSprite.setColor(sf::Color::Black);
 
     // Create gray scale shader
-    const std::string fragmentShader = \
-        "uniform sampler2D texture;" \
-        "uniform float grayScale;" \
-        "void main()" \
-        "{" \
-        // Read the pixel color
-        "    vec4 pixel = texture2D(texture, gl_TexCoord[0].xy);" \
-        // Determine the grayness of this pixel
-        "    float grayValue = (pixel.x + pixel.y + pixel.z)/3;" \
-        // Move each color value towards the gray pixel value by the grayScale amount and shift it towards sea blue (36, 187, 242) = (0.14, 0.73, 0.94) so that the water remains blue while the corals get bleached
-        "    float r = pixel.x + ((grayValue - pixel.x) * (grayScale * 0.50));" \
-        "    float g = pixel.y + ((grayValue - pixel.y) * (grayScale * 0.85));" \
-        "    float b = pixel.z + ((grayValue - pixel.z) * (grayScale * 0.94));" \
-        // Set the output pixel color (leave alpha channel as it was)
-        "    gl_FragColor = vec4(r, g + (0.2 * grayScale), b + (0.3 * grayScale), pixel.w);" \
-        "}";
-    reefShader.loadFromMemory(fragmentShader, sf::Shader::Fragment);
+    if (useBleachingLut && CreateBleachingLut("resources/bleaching_lut.png"))
+    {
+        const std::string fragmentShader = \
+            "uniform sampler2D texture;" \
+            "uniform sampler2D lut;" \
+            "uniform sampler2D health;" \
+            "uniform float alphaIsMask;" \
+            "uniform float lutSize;" \
+            "vec3 lookup(vec3 color)" \
+            "{" \
+            // Find the two blue slices around this color and the red/green position within a slice
+            "    float blue = color.z * (lutSize - 1.0);" \
+            "    float slice0 = floor(blue);" \
+            "    float slice1 = min(slice0 + 1.0, lutSize - 1.0);" \
+            "    vec2 position = vec2((color.x * (lutSize - 1.0) + 0.5) / (lutSize * lutSize), (color.y * (lutSize - 1.0) + 0.5) / lutSize);" \
+            // Red and green are interpolated by the texture sampler, blue between the two slices
+            "    vec3 color0 = texture2D(lut, position + vec2(slice0 / lutSize, 0.0)).xyz;" \
+            "    vec3 color1 = texture2D(lut, position + vec2(slice1 / lutSize, 0.0)).xyz;" \
+            "    return mix(color0, color1, blue - slice0);" \
+            "}" \
+            "void main()" \
+            "{" \
+            // Move the pixel towards its fully bleached color by how unhealthy the coral is here. The reef image has
+            // its coral mask in the alpha channel, so the water is left alone; other textures keep their alpha.
+            "    vec4 pixel = texture2D(texture, gl_TexCoord[0].xy);" \
+            "    float coral = mix(1.0, pixel.w, alphaIsMask);" \
+            "    float grayScale = (1.0 - texture2D(health, gl_TexCoord[0].xy).x) * coral;" \
+            "    gl_FragColor = vec4(mix(pixel.xyz, lookup(pixel.xyz), grayScale), mix(pixel.w, 1.0, alphaIsMask));" \
+            "}";
+        bleachingLut.setSmooth(true);
+        reefShader.loadFromMemory(fragmentShader, sf::Shader::Fragment);
+        reefShader.setUniform("lut", bleachingLut);
+        reefShader.setUniform("lutSize", (float)bleachingLutSize);
+    }
+    else
+    {
+        const std::string fragmentShader = \
+            "uniform sampler2D texture;" \
+            "uniform sampler2D health;" \
+            "uniform float alphaIsMask;" \
+            "uniform float bleachedPaleness;" \
+            "void main()" \
+            "{" \
+            // Read the pixel color, and how unhealthy the coral is here (none of the reef image's water is coral)
+            "    vec4 pixel = texture2D(texture, gl_TexCoord[0].xy);" \
+            "    float coral = mix(1.0, pixel.w, alphaIsMask);" \
+            "    float grayScale = (1.0 - texture2D(health, gl_TexCoord[0].xy).x) * coral;" \
+            // Determine the grayness of this pixel
+            "    float grayValue = (pixel.x + pixel.y + pixel.z)/3;" \
+            // Bleached coral loses its colour and pales, the water no longer needs to be kept blue by hand
+            "    vec3 bleached = mix(vec3(grayValue), vec3(1.0), bleachedPaleness);" \
+            // Set the output pixel color (the reef image's alpha is its mask, it is drawn opaque)
+            "    gl_FragColor = vec4(mix(pixel.xyz, bleached, grayScale), mix(pixel.w, 1.0, alphaIsMask));" \
+            "}";
+        reefShader.loadFromMemory(fragmentShader, sf::Shader::Fragment);
+        reefShader.setUniform("bleachedPaleness", bleachedPaleness);
+    }
     reefShader.setUniform("texture", sf::Shader::CurrentTexture);
+    reefShader.setUniform("health", healthTexture);
+    reefShader.setUniform("alphaIsMask", 0.0f);
+
+    // Create the cache the bleached reef is rendered into
+    reefCache.create((unsigned int)reefRect.width, (unsigned int)reefRect.height);
+    reefCache.setSmooth(true);
+    reefCacheSprite.setTexture(reefCache.getTexture());
+    reefCacheSprite.setPosition(reefRect.left, reefRect.top);
+
+    // Create the molecule atlas
+    CreateMoleculeAtlas(frameGovernor.DetailLevel);
 
     // Create text objects
-    int xPos = 20;
-    int yPos = 20;
-    yPos = SetText(textMenuTitle, 40, xPos, yPos, "Welcome to \"Save the Coral\" Simulation");
-    yPos = SetText(textMenuCarbonDioxide, 20, xPos, yPos, "To change the level of Carbon Dioxide: press 'Right' or 'Up' to increase; press 'Left' or 'Down' to decrease");
+    staticText.Font = &font;
+    LayOutText();
+}
+
+// Batch up the history chart's lines, a fixed number per species however long the history is
+void BuildHistoryBatch()
+{
+    historyBatch.clear();
+    size_t laneCount = std::min(levelHistory.GetSeriesCount(), allSpecies.size());
+    if (laneCount == 0)
+        return;
+
+    uint64_t span = (uint64_t)(historySpanSeconds[historySpan] * simulationStepRate);
+    float left = historyRect.left + historyNameWidth;
+    float columnWidth = (historyRect.width - historyNameWidth - 10) / historyColumns;
+    float laneHeight = (historyRect.height - 40) / laneCount;
+    for (size_t s = 0; s < laneCount; s++)
+    {
+        const VariableData& data = *allSpecies[s];
+        float range = data.GetRange() > 0 ? data.GetRange() : 1.0f;
+        float bottom = historyRect.top + 35 + (s + 1) * laneHeight - 2;
+        float height = laneHeight - 4;
+        levelHistory.GetColumns(s, span, historyColumns, historyMins, historyMaxs);
+
+        // Stretch each column's line to meet the previous one, so a steep change still draws as one line
+        float previousLow = NAN;
+        float previousHigh = NAN;
+        for (int c = 0; c < historyColumns; c++)
+        {
+            float low = std::clamp((historyMins[c] - data.Min) / range, 0.0f, 1.0f);
+            float high = std::clamp((historyMaxs[c] - data.Min) / range, 0.0f, 1.0f);
+            if (std::isnan(historyMins[c]))
+            {
+                previousLow = previousHigh = NAN;
+                continue;
+            }
+            float top = std::isnan(previousLow) ? high : std::max(high, previousLow);
+            float base = std::isnan(previousHigh) ? low : std::min(low, previousHigh);
+            previousLow = low;
+            previousHigh = high;
+
+            float x = left + (c + 0.5f) * columnWidth;
+            historyBatch.append(sf::Vertex(sf::Vector2f(x, bottom - top * height), data.Color));
+            historyBatch.append(sf::Vertex(sf::Vector2f(x, bottom - base * height + 1), data.Color));
+        }
+    }
+}
+
+void DrawHistory(sf::RenderTarget& target)
+{
+    sf::RectangleShape background(sf::Vector2f(historyRect.width, historyRect.height));
+    background.setPosition(historyRect.left, historyRect.top);
+    background.setFillColor(sf::Color(128, 128, 128, 200));
+    background.setOutlineColor(sf::Color::Black);
+    background.setOutlineThickness(1.0f);
+    target.draw(background);
+
+    sf::Text text(historySpanNames[historySpan], font, 20);
+    text.setFillColor(sf::Color::White);
+    text.setPosition(historyRect.left + 10, historyRect.top + 5);
+    target.draw(text);
+
+    size_t laneCount = std::min(levelHistory.GetSeriesCount(), allSpecies.size());
+    float laneHeight = laneCount > 0 ? (historyRect.height - 40) / laneCount : 0;
+    text.setCharacterSize(16);
+    for (size_t s = 0; s < laneCount; s++)
+    {
+        text.setString(allSpecies[s]->Name);
+        text.setPosition(historyRect.left + 10, historyRect.top + 35 + s * laneHeight + (laneHeight - 20) / 2);
+        target.draw(text);
+    }
+
+    target.draw(historyBatch);
+}
+
+// View that shows the visible part of the reef in the reef area of the layout
+sf::View GetReefView(const sf::View& layoutView)
+{
+    sf::FloatRect layoutViewport = layoutView.getViewport();
+    sf::View view(reefVisibleRect);
+    view.setViewport(sf::FloatRect(
+        layoutViewport.left + layoutViewport.width * reefRect.left / windowWidth,
+        layoutViewport.top + layoutViewport.height * reefRect.top / windowHeight,
+        layoutViewport.width * reefRect.width / windowWidth,
+        layoutViewport.height * reefRect.height / windowHeight));
+    return view;
+}
+
+void DrawScene(sf::RenderTarget& target, const SimulationSnapshot& snapshot)
+{
+    sf::View layoutView = target.getView();
+    target.setView(GetReefView(layoutView));
+
+    // Draw the reef
+    const VariableData& control = *allSpecies[speciesConfig.ControlSpecies];
+    float controlLevel = speciesConfig.ControlSpecies < (int)snapshot.Species.size() ? snapshot.Species[speciesConfig.ControlSpecies].Level : control.Min;
+    float grayScale = (controlLevel - control.Min) / control.GetRange();
+    UpdateReefCache(snapshot.Health, grayScale);
+    target.draw(reefCacheSprite);
+
+    // Draw the coral, bleached by the same health field as the reef under it
+    if (coralTexture.getSize().x > 0)
+        target.draw(coralSprite, &reefShader);
+
+    // Draw the water temperature
+    if (showTemperature && snapshot.Temperature.Width > 0)
+    {
+        UpdateTemperatureTexture(snapshot.Temperature);
+        target.draw(temperatureSprite);
+    }
+
+    // Draw the molecules
+    target.draw(moleculeBatch, &moleculeAtlas.getTexture());
+
+    // Draw the animals
+    target.draw(faunaBatch);
+
+    target.setView(layoutView);
+
+    // Draw the text
+    staticText.Draw(target);
+
+    // Draw the legend
+    for (const SpeciesConfig::LegendLayout& entry : speciesConfig.Legend)
+    {
+        if (entry.Species < (int)snapshot.Species.size())
+        {
+            bool hasBand = showEnsemble && entry.Species < (int)snapshot.Ensemble.size();
+            DrawLegend(target, entry, snapshot.Species[entry.Species].Level, hasBand ? &snapshot.Ensemble[entry.Species] : nullptr);
+        }
+    }
+
+    // Draw the history chart
+    if (showHistory)
+        DrawHistory(target);
+
+    // Draw the year the trajectory is at
+    if (trajectoryPlayer.IsPlaying())
+    {
+        std::string caption = std::to_string((int)std::floor(trajectoryPlayer.GetYear())) + " (" + trajectoryPlayer.GetScenarioName() + ")";
+        if (trajectoryPlayer.Paused)
+            caption += " paused";
+        sf::Text text(caption, font, 40);
+        text.setFillColor(sf::Color::White);
+        text.setOutlineColor(sf::Color::Black);
+        text.setOutlineThickness(2);
+        text.setPosition(reefRect.left + reefRect.width - text.getLocalBounds().width - 40, reefRect.top + 20);
+        target.draw(text);
+    }
+
+    // Draw the debugging overlay
+    profiler.Draw(target, font, sf::Vector2f(reefRect.left + 20, reefRect.top + 20));
 }
 
-int main()
+// A UDP or TCP port from the command line, 1 to 65535; false and a message otherwise
+bool ParsePort(const std::string& option, const char* text, unsigned short& port)
 {
-    Initialize();
+    char* end = nullptr;
+    long value = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || value < 1 || value > 65535)
+    {
+        std::cout << option << " expects a port from 1 to 65535, not \"" << text << "\"" << std::endl;
+        return false;
+    }
+    port = (unsigned short)value;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    // Parse the command line
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--fullscreen")
+        {
+            fullscreen = true;
+            if (i + 1 < argc && std::isdigit((unsigned char)argv[i + 1][0]))
+                fullscreenModeIndex = std::atoi(argv[++i]);
+        }
+        else if (argument == "--list-modes")
+        {
+            const std::vector<sf::VideoMode>& modes = sf::VideoMode::getFullscreenModes();
+            for (size_t m = 0; m < modes.size(); m++)
+                std::cout << m << ": " << modes[m].width << "x" << modes[m].height << " " << modes[m].bitsPerPixel << " bpp" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--target-fps" && i + 1 < argc)
+        {
+            targetFps = std::max((float)std::atof(argv[++i]), 1.0f);
+            batteryTargetFps = std::min(batteryTargetFps, targetFps);
+        }
+        else if (argument == "--telemetry-port" && i + 1 < argc)
+        {
+            if (!ParsePort(argument, argv[++i], telemetryPort))
+                return EXIT_FAILURE;
+        }
+        else if (argument == "--telemetry-rate" && i + 1 < argc)
+        {
+            // Samples per second
+            char* end = nullptr;
+            telemetryRate = std::strtof(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !std::isfinite(telemetryRate))
+            {
+                std::cout << "--telemetry-rate expects a number of samples per second" << std::endl;
+                return EXIT_FAILURE;
+            }
+            telemetryRate = std::max(telemetryRate, 0.1f);
+        }
+        else if (argument == "--telemetry-client" && i + 2 < argc)
+        {
+            std::string host = argv[++i];
+            unsigned short port = 0;
+            if (!ParsePort(argument, argv[++i], port))
+                return EXIT_FAILURE;
+            RunTelemetryClient(host, port);
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--control-port" && i + 1 < argc)
+        {
+            if (!ParsePort(argument, argv[++i], controlPort))
+                return EXIT_FAILURE;
+        }
+        else if (argument == "--remote" && i + 2 < argc)
+        {
+            // Send the rest of the command line to a running instance, e.g. --remote 127.0.0.1 5200 set-co2 150 benchmark 10
+            std::string host = argv[i + 1];
+            unsigned short port = 0;
+            std::vector<RemoteCommand> commands;
+            if (!ParsePort(argument, argv[i + 2], port) || !ParseRemoteCommands(std::vector<std::string>(argv + i + 3, argv + argc), commands) || !SendRemoteCommands(host, port, commands))
+            {
+                std::cout << "Usage: --remote <host> <port> [adjust-co2|set-co2|scenario|molecule-scale|benchmark <value>]..." << std::endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--leader" && i + 1 < argc)
+        {
+            // Followers to send the simulation to, e.g. --leader 127.0.0.1:5301,127.0.0.1:5302
+            leaderDestinations = argv[++i];
+        }
+        else if (argument == "--follower" && i + 1 < argc)
+        {
+            followerPort = (unsigned short)std::atoi(argv[++i]);
+        }
+        else if (argument == "--column" && i + 2 < argc)
+        {
+            // Show only this column of the reef, e.g. --column 1 3 for the middle of three displays
+            reefColumns = std::max(std::atoi(argv[i + 2]), 1);
+            reefColumn = std::clamp(std::atoi(argv[i + 1]), 0, reefColumns - 1);
+            i += 2;
+        }
+        else if (argument == "--benchmark")
+        {
+            RunMoleculeBenchmark();
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--ensemble" && i + 1 < argc)
+        {
+            ensembleMembers = std::max(std::atoi(argv[++i]), 0);
+        }
+        else if (argument == "--ensemble-benchmark")
+        {
+            if (!LoadSpeciesConfigFile())
+                return EXIT_FAILURE;
+            RunEnsembleBenchmark();
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--fauna-benchmark")
+        {
+            RunFaunaBenchmark();
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--species-config" && i + 1 < argc)
+        {
+            // Also applies to --headless and --replay-headless when given before them
+            speciesConfigFileName = argv[++i];
+        }
+        else if (argument == "--record" && i + 1 < argc)
+        {
+            recordFileName = argv[++i];
+        }
+        else if (argument == "--replay" && i + 1 < argc)
+        {
+            replayFileName = argv[++i];
+        }
+        else if (argument == "--replay-speed" && i + 1 < argc)
+        {
+            replaySpeed = std::max((float)std::atof(argv[++i]), 0.01f);
+        }
+        else if (argument == "--trajectory" && i + 1 < argc)
+        {
+            trajectoryScenario = argv[++i];
+        }
+        else if (argument == "--trajectory-file" && i + 1 < argc)
+        {
+            trajectoryFileName = argv[++i];
+        }
+        else if (argument == "--trajectory-speed" && i + 1 < argc)
+        {
+            // In years per second
+            trajectoryPlayer.YearsPerSecond = std::max((float)std::atof(argv[++i]), 0.01f);
+        }
+        else if (argument == "--replay-headless" && i + 1 < argc)
+        {
+            // Replay a recorded session as fast as possible and check that it ends the same way
+            std::string fileName = argv[++i];
+            if (!LoadSpeciesConfigFile())
+                return EXIT_FAILURE;
+            return RunSessionReplay(fileName) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (argument == "--levels-log" && i + 1 < argc)
+        {
+            // Also applies to --headless when given before it
+            levelLogFileName = argv[++i];
+        }
+        else if (argument == "--levels-csv" && i + 2 < argc)
+        {
+            if (!ConvertTimeSeriesToCsv(argv[i + 1], argv[i + 2]))
+            {
+                std::cout << "Could not convert " << argv[i + 1] << " to " << argv[i + 2] << std::endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--codec-benchmark")
+        {
+            RunSnapshotCodecBenchmark();
+            return EXIT_SUCCESS;
+        }
+        else if (argument == "--headless" && i + 1 < argc)
+        {
+            // Run the simulation for the given number of steps without opening a window
+            int steps = std::atoi(argv[++i]);
+            if (!LoadSpeciesConfigFile())
+                return EXIT_FAILURE;
+            JobSystem jobs(JobSystem::GetDefaultWorkerCount());
+            InitializeSimulation((uint32_t)std::time(nullptr));
+
+            if (!levelLogFileName.empty())
+                levelLog.Start(levelLogFileName, GetSpeciesNames());
+
+            sf::Clock clock;
+            std::vector<float> levels;
+            for (int step = 0; step < steps; step++)
+            {
+                StepSimulation(jobs);
+                GetSpeciesLevels(levels);
+                levelLog.Add(simulationStep, levels);
+            }
+            levelLog.Stop();
+            std::cout << steps << " steps in " << clock.getElapsedTime().asSeconds() << " s" << std::endl;
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if (!LoadSpeciesConfigFile())
+        return EXIT_FAILURE;
+
+    JobSystem jobs(JobSystem::GetDefaultWorkerCount());
+
+    sessionSeed = (uint32_t)std::time(nullptr);
+    float stepRate = simulationStepRate;
+    if (!replayFileName.empty())
+    {
+        if (!sessionPlayer.Load(replayFileName))
+        {
+            std::cout << "Could not read the session log " << replayFileName << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!sessionPlayer.CheckConfig())
+            return EXIT_FAILURE;
+        sessionSeed = sessionPlayer.Seed;
+        stepRate = sessionPlayer.StepRate * replaySpeed;
+        simulationThread.Player = &sessionPlayer;
+    }
+
+    Initialize(jobs);
+
+    if (!levelLogFileName.empty())
+    {
+        if (levelLog.Start(levelLogFileName, GetSpeciesNames()))
+            simulationThread.LevelLog = &levelLog;
+        else
+            std::cout << "Could not log the levels to " << levelLogFileName << std::endl;
+    }
+
+    if (ensembleMembers > 0)
+    {
+        chemistryEnsemble.Initialize(ensembleMembers, sessionSeed);
+        simulationThread.Ensemble = &chemistryEnsemble;
+    }
+
+    // A replayed session already has its carbon dioxide levels
+    if (!trajectoryScenario.empty() && replayFileName.empty())
+    {
+        std::string error;
+        if (!trajectoryPlayer.Start(trajectoryFileName, trajectoryScenario, error))
+            std::cout << error << std::endl;
+    }
+
+    if (!recordFileName.empty())
+    {
+        if (sessionRecorder.Start(recordFileName, sessionSeed, simulationStepRate, GetSpeciesConfigHash(speciesConfig)))
+            simulationThread.Recorder = &sessionRecorder;
+        else
+            std::cout << "Could not record the session to " << recordFileName << std::endl;
+    }
+
+    reefVisibleRect = reefRect;
+    reefVisibleRect.width = reefRect.width / reefColumns;
+    reefVisibleRect.left = reefRect.left + reefVisibleRect.width * reefColumn;
+
+    // A follower has no simulation of its own
+    bool follower = followerPort != 0;
+    if (follower)
+    {
+        if (!displayFollower.Start(followerPort))
+        {
+            std::cout << "Could not listen for the display leader on UDP port " << followerPort << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        // Every step goes into the history chart, also the ones never rendered
+        simulationThread.History = &levelHistory;
+        simulationThread.Start(jobs, stepRate);
+    }
+
+    if (!leaderDestinations.empty() && !displayLeader.Start(leaderDestinations))
+        std::cout << "No followers in \"" << leaderDestinations << "\", expected host:port,host:port,..." << std::endl;
+
+    if (telemetryPort != 0 && !telemetryServer.Start(telemetryPort, telemetryRate))
+        std::cout << "Could not stream telemetry on TCP port " << telemetryPort << std::endl;
+
+    if (controlPort != 0 && !remoteControl.Start(controlPort))
+        std::cout << "Could not listen for remote control on UDP port " << controlPort << std::endl;
+
+    frameGovernor.SetTargetFps(IsRunningOnBattery() ? batteryTargetFps : targetFps);
 
+    sf::Clock frameClock;
+    sf::Clock frameIntervalClock;
+    sf::Clock syncClock;
+    SimulationSnapshot followerSnapshot;
+    std::vector<SimulationCommand> remoteCommands;
+    std::vector<float> benchmarkRequests;
     while (window.isOpen())
     {
+        frameClock.restart();
+        float frameInterval = frameIntervalClock.restart().asSeconds();
+        frameTimeRecorder.Add(frameInterval);
+
         sf::Event event;
         while (window.pollEvent(event))
         {
@@ -279,63 +1252,191 @@ int main()
                 break;
             }
 
+            // Keep the layout letterboxed when the window is resized
+            if (event.type == sf::Event::Resized)
+                UpdateView();
+
+            // Keys that change what this screen shows work everywhere
+            if (event.type == sf::Event::KeyPressed)
+            {
+                switch (event.key.code)
+                {
+                case sf::Keyboard::T:
+                    showTemperature = !showTemperature;
+                    break;
+                case sf::Keyboard::E:
+                    showEnsemble = !showEnsemble;
+                    break;
+                case sf::Keyboard::H:
+                    showHistory = !showHistory;
+                    break;
+                case sf::Keyboard::Z:
+                    historySpan = (historySpan + 1) % historySpanCount;
+                    break;
+                case sf::Keyboard::F3:
+                    profiler.Visible = !profiler.Visible;
+                    break;
+                case sf::Keyboard::F11:
+                    fullscreen = !fullscreen;
+                    OpenWindow();
+                    break;
+                }
+            }
+
+            // Keys that change the simulation only work on the screen running it
             int changeAmount = 2;
-            if ((event.type == sf::Event::KeyPressed))
+            if ((event.type == sf::Event::KeyPressed) && !follower)
             {
                 switch (event.key.code)
                 {
                 case sf::Keyboard::A:
                 case sf::Keyboard::Up:
                 case sf::Keyboard::Right:
-                    AdjustCarbonDioxide(changeAmount);
+                    trajectoryPlayer.Stop();
+                    simulationThread.Post({ SimulationCommand::AdjustCarbonDioxide, (float)changeAmount });
                     break;
                 case sf::Keyboard::S:
                 case sf::Keyboard::Down:
                 case sf::Keyboard::Left:
-                    AdjustCarbonDioxide(-changeAmount);
+                    trajectoryPlayer.Stop();
+                    simulationThread.Post({ SimulationCommand::AdjustCarbonDioxide, (float)-changeAmount });
+                    break;
+                case sf::Keyboard::Space:
+                    trajectoryPlayer.Paused = !trajectoryPlayer.Paused;
+                    break;
+                case sf::Keyboard::PageUp:
+                    trajectoryPlayer.Seek(trajectoryPlayer.GetYear() + trajectorySeekYears);
+                    break;
+                case sf::Keyboard::PageDown:
+                    trajectoryPlayer.Seek(trajectoryPlayer.GetYear() - trajectorySeekYears);
+                    break;
+                case sf::Keyboard::Home:
+                    trajectoryPlayer.Seek(0);
+                    break;
+                case sf::Keyboard::Add:
+                case sf::Keyboard::Equal:
+                    trajectoryPlayer.YearsPerSecond *= trajectorySpeedFactor;
+                    break;
+                case sf::Keyboard::Subtract:
+                case sf::Keyboard::Hyphen:
+                    trajectoryPlayer.YearsPerSecond /= trajectorySpeedFactor;
                     break;
                 }
             }
         }
 
+        if (!window.isOpen())
+            break;
+
+        ReloadSpeciesConfigIfChanged(jobs, stepRate, !follower);
+
+        // Follow the trajectory; the level is only looked up in the rows already parsed
+        float trajectoryLevel;
+        if (!follower && trajectoryPlayer.Update(frameInterval, trajectoryLevel))
+            simulationThread.Post({ SimulationCommand::SetCarbonDioxide, trajectoryLevel });
+
+        // Hand the remote commands that arrived since the last frame to the simulation in one batch
+        remoteCommands.clear();
+        benchmarkRequests.clear();
+        remoteControl.Poll(remoteCommands, benchmarkRequests);
+        if (!remoteCommands.empty() && !follower)
+            simulationThread.Post(remoteCommands);
+        for (float seconds : benchmarkRequests)
+            frameTimeRecorder.Start(seconds);
+
+        // Take the newest complete simulation step, or the leader's step interpolated to this frame, and batch up its molecules
+        displayFollower.Poll();
+        bool hasSnapshot = !follower || displayFollower.GetSnapshot(followerSnapshot);
+        const SimulationSnapshot& snapshot = follower ? followerSnapshot : simulationThread.AcquireSnapshot();
+        if (!hasSnapshot)
+        {
+            // Nothing to show until the leader's first step arrives
+            window.clear(sf::Color::Black);
+            window.display();
+            continue;
+        }
+        BuildMoleculeBatch(snapshot, frameGovernor.MoleculeDensity);
+        BuildFaunaBatch(snapshot.Fauna);
+        if (follower)
+        {
+            // A follower only has the leader's steps it renders
+            speciesLevels.resize(snapshot.Species.size());
+            for (size_t s = 0; s < snapshot.Species.size(); s++)
+                speciesLevels[s] = snapshot.Species[s].Level;
+            levelHistory.Record(snapshot.Step, speciesLevels);
+        }
+        if (showHistory)
+            BuildHistoryBatch();
+        int coralTilesUploaded = UpdateCoralTexture(snapshot.Coral);
+        displayLeader.Send(snapshot, syncClock.getElapsedTime().asSeconds());
+
+        profiler.Set("Frame time (ms)", frameGovernor.AverageFrameTime * 1000);
+        profiler.Set("Render scale", frameGovernor.RenderScale);
+        profiler.Set("Molecules drawn", moleculeBatch.getVertexCount() / 4);
+        profiler.Set("Animals drawn", faunaBatch.getVertexCount() / 3);
+        profiler.Set("History chart vertices", historyBatch.getVertexCount());
+        if (simulationThread.Ensemble)
+            profiler.Set("Ensemble member steps per second", chemistryEnsemble.MemberCount * simulationThread.StepsPerSecond);
+        profiler.Set("Simulation steps per second", simulationThread.StepsPerSecond);
+        profiler.Set("Simulation step", (double)snapshot.Step);
+        profiler.Set("Dropped simulation steps", (double)simulationThread.DroppedSteps);
+        profiler.Set("Dropped telemetry samples", (double)telemetryServer.DroppedSamples);
+        profiler.Set("Duplicated frames", (double)simulationThread.DuplicatedFrames);
+        profiler.Set("Coral tiles uploaded", coralTilesUploaded);
+        profiler.Set("Telemetry clients", (double)telemetryServer.GetClientCount());
+        if (follower)
+        {
+            profiler.Set("Sync datagrams", (double)displayFollower.ReceivedDatagrams);
+            profiler.Set("Lost sync steps", (double)displayFollower.LostSteps);
+        }
+
+        telemetryServer.Update(snapshot, frameGovernor.AverageFrameTime, simulationThread.StepsPerSecond);
+
         //
         // Draw the window
         //
 
-        window.clear(sf::Color::White); // Clear the window to white
-
-        // Draw the reef
-        float grayScale = (carbonDioxide.Level - carbonDioxide.Min) / (carbonDioxide.Max - carbonDioxide.Min);
-        reefShader.setUniform("grayScale", grayScale);
-        window.draw(reefSprite, &reefShader);
-
-        // Draw the molecules
-        carbonDioxide.DrawShapes();
-        carbonicAcid.DrawShapes();
-        carbonate.DrawShapes();
-        biCarbonate.DrawShapes();
-        calciumCarbonate.DrawShapes();
-
-        // Draw the text
-        window.draw(textMenuTitle);
-        window.draw(textMenuCarbonDioxide);
-
-        float x = 1000;
-        float y = 30;
-        y = carbonDioxide.DrawLegend(x, y);
-        y = carbonicAcid.DrawLegend(x, y);
-        y = biCarbonate.DrawLegend(x, y);
-        y = carbonate.DrawLegend(x, y);
-        y = calciumCarbonate.DrawLegend(x, y);
-
-        x = 1500;
-        y = 30;
-        y = phLevel.DrawLegend(x, y, false);
-        y = waterTemperature.DrawLegend(x, y, false);
+        window.clear(sf::Color::Black); // Clear the window (and the letterbox bars) to black
+
+        float renderScale = frameGovernor.RenderScale;
+        if (renderScale < 1.0f)
+        {
+            // Render the scene into the top-left part of the internal target and stretch that over the layout
+            sf::View scaledView(sf::FloatRect(0.0f, 0.0f, windowWidth, windowHeight));
+            scaledView.setViewport(sf::FloatRect(0.0f, 0.0f, renderScale, renderScale));
+            sceneTexture.setView(scaledView);
+            sceneTexture.clear(sf::Color::White);
+            DrawScene(sceneTexture, snapshot);
+            sceneTexture.display();
+
+            sf::Vector2u size = sceneTexture.getSize();
+            sf::IntRect rect(0, 0, (int)(size.x * renderScale), (int)(size.y * renderScale));
+            sceneSprite.setTextureRect(rect);
+            sceneSprite.setScale(windowWidth / rect.width, windowHeight / rect.height);
+            window.draw(sceneSprite);
+        }
+        else
+        {
+            // Render straight into the window, filling only the layout area so the letterbox bars stay black
+            sf::RectangleShape background(sf::Vector2f(windowWidth, windowHeight));
+            background.setFillColor(sf::Color::White);
+            window.draw(background);
+            DrawScene(window, snapshot);
+        }
+
+        // Let the governor trade quality for speed based on the work done this frame (excluding the wait for vsync)
+        int detailLevel = frameGovernor.DetailLevel;
+        if (frameGovernor.Update(frameClock.getElapsedTime().asSeconds()) && frameGovernor.DetailLevel != detailLevel)
+            CreateMoleculeAtlas(frameGovernor.DetailLevel);
 
         // Display things on screen
         window.display();
     }
 
+    telemetryServer.Stop();
+    simulationThread.Stop();
+    sessionRecorder.Stop(simulationStep);
+    levelLog.Stop();
+
     return EXIT_SUCCESS;
 }